@@ -0,0 +1,255 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "CPURaycaster.h"
+
+// rays traced together, their per sample math runs in loops over the
+// packet that the compiler can vectorize
+static const uint32_t packetSize = 8;
+
+// trilinear lookup with texel centers at (i+0.5)/size and clamping at
+// the border, i.e. what GL_LINEAR and GL_CLAMP_TO_EDGE return
+template <typename T>
+static float sampleVolume(const VolumeT<T>& volume, const T* voxels,
+                          float x, float y, float z) {
+  const float fx = std::min(std::max(x*float(volume.width)-0.5f, 0.0f), float(volume.width-1));
+  const float fy = std::min(std::max(y*float(volume.height)-0.5f, 0.0f), float(volume.height-1));
+  const float fz = std::min(std::max(z*float(volume.depth)-0.5f, 0.0f), float(volume.depth-1));
+  const size_t x0 = size_t(fx), y0 = size_t(fy), z0 = size_t(fz);
+  const size_t x1 = std::min(x0+1, volume.width-1);
+  const size_t y1 = std::min(y0+1, volume.height-1);
+  const size_t z1 = std::min(z0+1, volume.depth-1);
+  const float ax = fx-float(x0), ay = fy-float(y0), az = fz-float(z0);
+
+  const size_t sliceSize = volume.width*volume.height;
+  const T* s0 = voxels + z0*sliceSize;
+  const T* s1 = voxels + z1*sliceSize;
+  const float c00 = float(s0[x0+y0*volume.width])*(1-ax) + float(s0[x1+y0*volume.width])*ax;
+  const float c01 = float(s0[x0+y1*volume.width])*(1-ax) + float(s0[x1+y1*volume.width])*ax;
+  const float c10 = float(s1[x0+y0*volume.width])*(1-ax) + float(s1[x1+y0*volume.width])*ax;
+  const float c11 = float(s1[x0+y1*volume.width])*(1-ax) + float(s1[x1+y1*volume.width])*ax;
+  const float c0 = c00*(1-ay) + c01*ay;
+  const float c1 = c10*(1-ay) + c11*ay;
+  return (c0*(1-az) + c1*az) / float(std::numeric_limits<T>::max());
+}
+
+template <typename T>
+Image CPURaycaster::render(const VolumeT<T>& volume, uint32_t width, uint32_t height,
+                           const Mat4& modelViewProjection,
+                           const MacroCellGrid* grid) const {
+  Image image{width, height, 4};
+  if (volume.getVoxelCount() == 0 || width == 0 || height == 0) return image;
+
+  std::vector<uint8_t> occupancy;
+  if (grid) occupancy = grid->computeOccupancy(smoothStepStart, smoothStepWidth);
+  // built for the step length of a ray along the longest axis, other
+  // rays correct the opacity of the table entries
+  PreIntegrationTable table;
+  if (preIntegration) {
+    const size_t maxDim = std::max(volume.width, std::max(volume.height, volume.depth));
+    table = PreIntegrationTable{PreIntegrationTable::smoothStep(smoothStepStart, smoothStepWidth,
+                                                                preIntegrationSize),
+                                100.0f/(float(maxDim)*oversampling)};
+  }
+
+  const Mat4 clipToTexture = Mat4::translation({0.5f,0.5f,0.5f}) *
+                             Mat4::inverse(modelViewProjection);
+  const uint32_t tilesX = (width+tileSize-1)/tileSize;
+  const uint32_t tilesY = (height+tileSize-1)/tileSize;
+  const int64_t tileCount = int64_t(tilesX)*int64_t(tilesY);
+
+  // tiles differ a lot in cost (empty vs. dense regions), so idle
+  // threads keep grabbing the next one instead of a static split
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int64_t t = 0;t<tileCount;++t) {
+    const uint32_t x0 = uint32_t(t % tilesX) * tileSize;
+    const uint32_t y0 = uint32_t(t / tilesX) * tileSize;
+    const uint32_t x1 = std::min(width, x0+tileSize);
+    const uint32_t y1 = std::min(height, y0+tileSize);
+    for (uint32_t y = y0;y<y1;++y)
+      for (uint32_t x = x0;x<x1;x += packetSize)
+        renderPacket(volume, clipToTexture, grid, grid ? occupancy.data() : nullptr,
+                     preIntegration ? &table : nullptr,
+                     x, y, std::min(packetSize, x1-x), width, height, image);
+  }
+  return image;
+}
+
+template <typename T>
+void CPURaycaster::renderPacket(const VolumeT<T>& volume, const Mat4& clipToTexture,
+                                const MacroCellGrid* grid, const uint8_t* occupancy,
+                                const PreIntegrationTable* table, uint32_t x, uint32_t y, uint32_t count,
+                                uint32_t width, uint32_t height, Image& image) const {
+  float px[packetSize], py[packetSize], pz[packetSize];
+  float dx[packetSize], dy[packetSize], dz[packetSize];
+  float opacityCorrection[packetSize];
+  float r[packetSize], g[packetSize], b[packetSize], a[packetSize];
+  float value[packetSize];
+  float stepScale[packetSize], lastValue[packetSize];
+  int32_t steps[packetSize];
+
+  const Vec3 voxelCount{float(volume.width), float(volume.height), float(volume.depth)};
+  const T* voxels = volume.getData();
+
+  // ray setup, entry and exit of the clip box are found analytically
+  // and turned into a step count instead of testing bounds per sample
+  for (uint32_t i = 0;i<packetSize;++i) {
+    r[i] = g[i] = b[i] = a[i] = 0.0f;
+    stepScale[i] = 1.0f;
+    lastValue[i] = -1.0f;
+    steps[i] = 0;
+    px[i] = py[i] = pz[i] = dx[i] = dy[i] = dz[i] = opacityCorrection[i] = 0.0f;
+    if (i >= count) continue;
+
+    const float ndcX = (float(x+i)+0.5f)/float(width)*2.0f-1.0f;
+    const float ndcY = (float(y)+0.5f)/float(height)*2.0f-1.0f;
+    const Vec3 nearPoint = clipToTexture * Vec3{ndcX, ndcY, -1.0f};
+    const Vec3 farPoint = clipToTexture * Vec3{ndcX, ndcY, 1.0f};
+    const Vec3 direction = Vec3::normalize(farPoint-nearPoint);
+
+    float tEnter = 0.0f;
+    float tExit = std::numeric_limits<float>::max();
+    for (size_t c = 0;c<3;++c) {
+      if (direction[c] == 0.0f) {
+        if (nearPoint[c] < minBounds[c] || nearPoint[c] > maxBounds[c]) tExit = -1.0f;
+        continue;
+      }
+      const float t0 = (minBounds[c]-nearPoint[c])/direction[c];
+      const float t1 = (maxBounds[c]-nearPoint[c])/direction[c];
+      tEnter = std::max(tEnter, std::min(t0, t1));
+      tExit = std::min(tExit, std::max(t0, t1));
+    }
+    if (tEnter > tExit) continue;
+
+    const float samples = std::fabs(direction.x)*voxelCount.x +
+                          std::fabs(direction.y)*voxelCount.y +
+                          std::fabs(direction.z)*voxelCount.z;
+    const float stepLength = 1.0f/(samples*oversampling);
+    const Vec3 entry = nearPoint + direction*tEnter;
+    px[i] = entry.x; py[i] = entry.y; pz[i] = entry.z;
+    dx[i] = direction.x*stepLength;
+    dy[i] = direction.y*stepLength;
+    dz[i] = direction.z*stepLength;
+    opacityCorrection[i] = 100.0f*stepLength;
+    steps[i] = int32_t((tExit-tEnter)/stepLength)+1;
+  }
+
+  // macro cell index of a texture space position
+  const float cellScaleX = voxelCount.x/float(grid ? grid->cellSize : 1);
+  const float cellScaleY = voxelCount.y/float(grid ? grid->cellSize : 1);
+  const float cellScaleZ = voxelCount.z/float(grid ? grid->cellSize : 1);
+
+  const float start = smoothStepStart;
+  const float invWidth = 1.0f/smoothStepWidth;
+  while (true) {
+    bool anyActive = false;
+    for (uint32_t i = 0;i<packetSize;++i) {
+      // leap over empty macro cells, staying on the sample positions
+      while (occupancy && steps[i] > 0) {
+        const size_t cx = std::min(size_t(std::max(px[i]*cellScaleX, 0.0f)), grid->cellsX-1);
+        const size_t cy = std::min(size_t(std::max(py[i]*cellScaleY, 0.0f)), grid->cellsY-1);
+        const size_t cz = std::min(size_t(std::max(pz[i]*cellScaleZ, 0.0f)), grid->cellsZ-1);
+        if (occupancy[cx + cy*grid->cellsX + cz*grid->cellsX*grid->cellsY]) break;
+        const float tx = ((float(cx) + (dx[i] >= 0.0f ? 1.0f : 0.0f))/cellScaleX - px[i])/dx[i];
+        const float ty = ((float(cy) + (dy[i] >= 0.0f ? 1.0f : 0.0f))/cellScaleY - py[i])/dy[i];
+        const float tz = ((float(cz) + (dz[i] >= 0.0f ? 1.0f : 0.0f))/cellScaleZ - pz[i])/dz[i];
+        const float skip = std::max(1.0f, std::ceil(std::min(tx, std::min(ty, tz))));
+        px[i] += dx[i]*skip;
+        py[i] += dy[i]*skip;
+        pz[i] += dz[i]*skip;
+        steps[i] -= int32_t(std::min(skip, float(steps[i])));
+        stepScale[i] = 1.0f;
+        lastValue[i] = -1.0f;
+      }
+      anyActive |= steps[i] > 0;
+    }
+    if (!anyActive) break;
+
+    // the gather is scalar, everything after it runs across the packet
+    for (uint32_t i = 0;i<packetSize;++i)
+      value[i] = (steps[i] > 0) ? sampleVolume(volume, voxels, px[i], py[i], pz[i])*valueMapping.scale +
+                                  valueMapping.offset : 0.0f;
+
+    const float maxScale = adaptiveSampling ? maxStepScale : 1.0f;
+    for (uint32_t i = 0;i<packetSize;++i) {
+      const float active = (steps[i] > 0) ? 1.0f : 0.0f;
+      // the segment from the previous sample, the first sample of a run
+      // has none and is treated as a constant segment
+      const float front = (lastValue[i] < 0.0f) ? value[i] : lastValue[i];
+      const float segment = stepScale[i];
+      // adaptive sampling: grow the step while the data barely changes,
+      // fall back to the base step as soon as it does
+      const float change = std::fabs(value[i]-lastValue[i]);
+      stepScale[i] = (change < adaptiveTolerance) ? std::min(stepScale[i]*2.0f, maxScale) : 1.0f;
+      lastValue[i] = value[i];
+
+      float cr, cg, cb, alpha;
+      if (table) {
+        const Vec4 entry = table->lookup(front, value[i]);
+        cr = entry.x; cg = entry.y; cb = entry.z;
+        const float exponent = opacityCorrection[i]*segment/table->segmentLength;
+        alpha = (1.0f-std::pow(1.0f-entry.w, exponent))*active;
+      } else {
+        // transferFunction
+        float v = std::min(std::max((value[i]-start)*invWidth, 0.0f), 1.0f);
+        v = v*v*(3.0f-2.0f*v);
+        cr = cg = cb = v;
+        // opacity correction for the step length
+        alpha = (1.0f-std::pow(1.0f-v, opacityCorrection[i]*stepScale[i]))*active;
+      }
+      // under
+      const float weight = (1.0f-a[i])*alpha;
+      r[i] += weight*cr;
+      g[i] += weight*cg;
+      b[i] += weight*cb;
+      a[i] += weight;
+      px[i] += dx[i]*stepScale[i];
+      py[i] += dy[i]*stepScale[i];
+      pz[i] += dz[i]*stepScale[i];
+      // early ray termination
+      steps[i] = (a[i] >= terminationThreshold) ? 0 : steps[i] - int32_t(stepScale[i]*active);
+    }
+  }
+
+  for (uint32_t i = 0;i<count;++i) {
+    const float rgb[3] = {r[i], g[i], b[i]};
+    for (uint8_t c = 0;c<3;++c) {
+      const float blended = rgb[c]*a[i] + background[c]*(1.0f-a[i]);
+      image.setValue(x+i, y, c, uint8_t(std::min(std::max(blended, 0.0f), 1.0f)*255.0f+0.5f));
+    }
+    image.setValue(x+i, y, 3, 255);
+  }
+}
+
+CPURaycaster::ImageError CPURaycaster::compare(const Image& image, const Image& reference) {
+  ImageError error{0.0, std::numeric_limits<double>::infinity(), 0};
+  if (image.width != reference.width || image.height != reference.height) {
+    error.rmse = std::numeric_limits<double>::infinity();
+    error.psnr = 0.0;
+    error.maxError = 255;
+    return error;
+  }
+
+  double sum = 0.0;
+  for (uint32_t y = 0;y<image.height;++y) {
+    for (uint32_t x = 0;x<image.width;++x) {
+      for (uint8_t c = 0;c<3;++c) {
+        const int32_t d = int32_t(image.getValue(x, y, c)) - int32_t(reference.getValue(x, y, c));
+        sum += double(d*d);
+        error.maxError = std::max(error.maxError, uint8_t(std::abs(d)));
+      }
+    }
+  }
+  const double count = double(image.width)*double(image.height)*3.0;
+  error.rmse = std::sqrt(sum/std::max(count, 1.0));
+  if (error.rmse > 0.0) error.psnr = 20.0*std::log10(255.0/error.rmse);
+  return error;
+}
+
+template Image CPURaycaster::render(const Volume& volume, uint32_t width, uint32_t height,
+                                    const Mat4& modelViewProjection,
+                                    const MacroCellGrid* grid) const;
+template Image CPURaycaster::render(const Volume16& volume, uint32_t width, uint32_t height,
+                                    const Mat4& modelViewProjection,
+                                    const MacroCellGrid* grid) const;
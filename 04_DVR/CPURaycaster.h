@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Image.h>
+#include <Mat4.h>
+#include <Vec4.h>
+
+#include "Volume.h"
+#include "MacroCellGrid.h"
+#include "PreIntegration.h"
+
+// CPU reference implementation of the raycaster in cubeFS.glsl, same
+// smoothstep transfer function, front-to-back "under" compositing and
+// clip box bounds, usable without a GPU or window
+class CPURaycaster {
+public:
+  float smoothStepStart{0.12f};
+  float smoothStepWidth{0.1f};
+  // applied to every sample before the transfer function, see
+  // computeValueMapping; the macro cell grid has to use the same
+  ValueMapping valueMapping;
+  float oversampling{2.0f};
+  // clip box in texture space
+  Vec3 minBounds{0.0f, 0.0f, 0.0f};
+  Vec3 maxBounds{1.0f, 1.0f, 1.0f};
+  // rays stop once their accumulated opacity reaches this value
+  float terminationThreshold{0.99f};
+  // doubles the step, up to maxStepScale times the base step, while
+  // consecutive samples differ by less than adaptiveTolerance
+  bool adaptiveSampling{false};
+  float maxStepScale{4.0f};
+  float adaptiveTolerance{0.01f};
+  // composites whole segments between two samples with a pre-integrated
+  // table of preIntegrationSize^2 entries instead of single samples
+  bool preIntegration{false};
+  size_t preIntegrationSize{256};
+  // the color the GUI clears to, blended like glBlendFunc(SRC_ALPHA, ONE_MINUS_SRC_ALPHA)
+  Vec4 background{0.0f, 0.0f, 0.5f, 1.0f};
+  // the image is split into square tiles handed out dynamically to the threads
+  uint32_t tileSize{16};
+
+  // modelViewProjection maps the volume cube [-0.5, 0.5]^3 to clip
+  // space, exactly as in the GUI;
+  // given a macro cell grid of the volume, cells the transfer function
+  // maps to zero opacity are skipped the same way the shader does
+  template <typename T>
+  Image render(const VolumeT<T>& volume, uint32_t width, uint32_t height,
+               const Mat4& modelViewProjection,
+               const MacroCellGrid* grid=nullptr) const;
+
+  struct ImageError {
+    double rmse;
+    double psnr;
+    uint8_t maxError;
+  };
+
+  // difference of the color channels of two equally sized images
+  static ImageError compare(const Image& image, const Image& reference);
+
+private:
+  template <typename T>
+  void renderPacket(const VolumeT<T>& volume, const Mat4& clipToTexture,
+                    const MacroCellGrid* grid, const uint8_t* occupancy,
+                    const PreIntegrationTable* table, uint32_t x, uint32_t y, uint32_t count,
+                    uint32_t width, uint32_t height, Image& image) const;
+};
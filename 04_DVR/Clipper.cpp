@@ -1,197 +1,142 @@
 #include "Clipper.h"
+#include <cmath>
+#include <limits>
 #include <algorithm>
-#include <functional>
 
-
-static bool epsilonEqual(float a, float b) {
-  return fabs(a-b) <= std::numeric_limits<float>::epsilon();
-}
-
-// Calculates the intersection point of a line segment lb->la which crosses the
-// plane with normal 'n'.
-static bool rayPlaneIntersection(const Vec3 &la,
-                                 const Vec3 &lb,
-                                 const Vec3 &n, const float D,
-                                 Vec3 &hit)
-{
-  const float denom = Vec3::dot(n, (la - lb));
-
-  if(epsilonEqual(denom, 0.0f)) {
-    return false;
-  }
-
-  const float t = (Vec3::dot(n, la) + D) / denom;
-  hit = la + (lb - la)*t;
-  return true;
-}
-
-
-// Splits a triangle along a plane with the given normal.
-// Assumes: plane's D == 0.
-//          triangle does span the plane.
-static void splitTriangle(Vec3 a,
-                   Vec3 b,
-                   Vec3 c,
-                   float fa, 
-                   float fb,
-                   float fc,
-                   const Vec3 &normal,
-                   const float D,
-                   std::vector<Vec3>& out,
-                   std::vector<Vec3>& newVerts)
-{
-  // rotation / mirroring.
-  //            c
-  //           o          Push `c' to be alone on one side of the plane, making
-  //          / \         `a' and `b' on the other.  Later we'll be able to
-  // plane ---------      assume that there will be an intersection with the
-  //        /     \       clip plane along the lines `ac' and `bc'.  This
-  //       o-------o      reduces the number of cases below.
-  //      a         b
-
-  // if fa*fc is non-negative, both have the same sign -- and thus are on the
-  // same side of the plane.
-  if(fa*fc >= 0) {
-    std::swap(fb, fc);
-    std::swap(b, c);
-    std::swap(fa, fb);
-    std::swap(a, b);
-  } else if(fb*fc >= 0) {
-    std::swap(fa, fc);
-    std::swap(a, c);
-    std::swap(fa, fb);
-    std::swap(a, b);
-  }
-
-  // Find the intersection points.
-  Vec3 A, B;
-  rayPlaneIntersection(a,c, normal,D, A);
-  rayPlaneIntersection(b,c, normal,D, B);
-
-  if(fc >= 0) {
-    out.push_back(a); out.push_back(b); out.push_back(A);
-    out.push_back(b); out.push_back(B); out.push_back(A);
-  } else {
-    out.push_back(A); out.push_back(B); out.push_back(c);
-  }
-  newVerts.push_back(A);
-  newVerts.push_back(B);
-}
-
-
-std::vector<Vec3> Clipper::triPlane(std::vector<Vec3>& posData, const Vec3 &normal, const float D) {
-  std::vector<Vec3> newVertices;
-  std::vector<Vec3> out;
-  if (posData.size() % 3 != 0) return newVertices;
-
-  for(auto iter = posData.begin(); iter < (posData.end()-2); iter += 3) {
-
-    const Vec3 &a = (*iter);
-    const Vec3 &b = (*(iter+1));
-    const Vec3 &c = (*(iter+2));
-
-    float fa = Vec3::dot(normal, a) + D;
-    float fb = Vec3::dot(normal, b) + D;
-    float fc = Vec3::dot(normal, c) + D;
-    if(fabs(fa) < (2 * std::numeric_limits<float>::epsilon())) { fa = 0; }
-    if(fabs(fb) < (2 * std::numeric_limits<float>::epsilon())) { fb = 0; }
-    if(fabs(fc) < (2 * std::numeric_limits<float>::epsilon())) { fc = 0; }
-    if(fa >= 0 && fb >= 0 && fc >= 0) {        // trivial reject
-      // discard -- i.e. do nothing / ignore tri.
-      continue;
-    } else if(fa <= 0 && fb <= 0 && fc <= 0) { // trivial accept
-      out.push_back(a);
-      out.push_back(b);
-      out.push_back(c);
-    } else { // triangle spans plane -- must be split.
-      std::vector<Vec3> tris, newVerts;
-      splitTriangle(a,b,c, fa,fb,fc,normal,D, tris, newVerts);
-
-      // append triangles and vertices to lists
-      out.insert(out.end(), tris.begin(), tris. end());
-      newVertices.insert(newVertices.end(), newVerts.begin(), newVerts. end());
+// Sutherland-Hodgman clipping of every face of the convex polytope in
+// scratch.faces against one plane, the points on the plane are collected
+// for the cap; returns false if nothing was clipped
+static bool clipPolytope(Clipper::Scratch& scratch, const Clipper::Plane& plane) {
+  const float epsilon = 2 * std::numeric_limits<float>::epsilon();
+  bool anyOutside = false;
+  for (const Vec3& v : scratch.faces) {
+    if (Vec3::dot(plane.normal, v) + plane.D > epsilon) {
+      anyOutside = true;
+      break;
     }
   }
-
-  posData = out;
-  return newVertices;
-}
-
-struct compSorter {
-  bool operator() (const Vec3& i, const Vec3& j) const {
-    return i.x < j.x || (i.x == j.x && i.y < j.y) ||
-           (i.x == j.x && i.y == j.y && i.z < j.z);
+  if (!anyOutside) return false;
+
+  scratch.clippedFaces.clear();
+  scratch.clippedFaceSizes.clear();
+  scratch.cap.clear();
+
+  size_t first = 0;
+  for (const size_t faceSize : scratch.faceSizes) {
+    const size_t start = scratch.clippedFaces.size();
+    for (size_t i = 0;i<faceSize;++i) {
+      const Vec3& current = scratch.faces[first+i];
+      const Vec3& next = scratch.faces[first+(i+1)%faceSize];
+      float dc = Vec3::dot(plane.normal, current) + plane.D;
+      float dn = Vec3::dot(plane.normal, next) + plane.D;
+      if (fabs(dc) < epsilon) dc = 0;
+      if (fabs(dn) < epsilon) dn = 0;
+
+      if (dc <= 0) {
+        scratch.clippedFaces.push_back(current);
+        if (dc == 0) scratch.cap.push_back({0.0f, current});
+      }
+      if ((dc < 0 && dn > 0) || (dc > 0 && dn < 0)) {
+        const Vec3 hit = current + (next - current) * (dc / (dc - dn));
+        scratch.clippedFaces.push_back(hit);
+        scratch.cap.push_back({0.0f, hit});
+      }
+    }
+    const size_t clippedSize = scratch.clippedFaces.size() - start;
+    if (clippedSize < 3)
+      scratch.clippedFaces.resize(start);
+    else
+      scratch.clippedFaceSizes.push_back(clippedSize);
+    first += faceSize;
   }
-};
-
-static bool angleSorter(const Vec3& i, const Vec3& j, const Vec3& center, const Vec3& refVec, const Vec3& normal) {
-  Vec3 vecI = Vec3::normalize(i-center);
-  float cosI = Vec3::dot(refVec, vecI);
-  float sinI = Vec3::dot(Vec3::cross(vecI, refVec), normal);
-
-  Vec3 vecJ = Vec3::normalize(j-center);
-  float cosJ = Vec3::dot(refVec, vecJ);
-  float sinJ = Vec3::dot(Vec3::cross(vecJ, refVec), normal);
-
-  float acI = atan2(sinI, cosI);
-  float acJ = atan2(sinJ, cosJ);
-
-  return acI > acJ;
-}
 
-static std::vector<Vec3> rawToVec3(const std::vector<float>& posData) {
-  std::vector<Vec3> v(posData.size()/3);
-  for (size_t i = 0;i<posData.size()/3;++i) {
-    v[i] = Vec3{posData[i*3+0],posData[i*3+1],posData[i*3+2]};
+  // the cap is convex, so sorting its points by angle around their
+  // center orders them counter clockwise seen from outside (+normal)
+  if (scratch.cap.size() >= 3) {
+    Vec3 center;
+    for (const auto& p : scratch.cap) center = center + p.second;
+    center = center / float(scratch.cap.size());
+
+    Vec3 axis;
+    for (const auto& p : scratch.cap) {
+      if (Vec3::dot(p.second-center, p.second-center) > Vec3::dot(axis, axis))
+        axis = p.second-center;
+    }
+    if (Vec3::dot(axis, axis) > 0) {
+      const Vec3 u = Vec3::normalize(axis);
+      const Vec3 v = Vec3::cross(Vec3::normalize(plane.normal), u);
+      for (auto& p : scratch.cap)
+        p.first = atan2(Vec3::dot(p.second-center, v), Vec3::dot(p.second-center, u));
+      std::sort(scratch.cap.begin(), scratch.cap.end(),
+                [](const std::pair<float, Vec3>& a, const std::pair<float, Vec3>& b) {
+                  return a.first < b.first;
+                });
+
+      // every cut edge is shared by two faces, drop the duplicates
+      const size_t start = scratch.clippedFaces.size();
+      for (const auto& p : scratch.cap) {
+        if (scratch.clippedFaces.size() > start) {
+          const Vec3 d = p.second - scratch.clippedFaces.back();
+          if (Vec3::dot(d, d) <= 1e-12f) continue;
+        }
+        scratch.clippedFaces.push_back(p.second);
+      }
+      while (scratch.clippedFaces.size() - start > 1) {
+        const Vec3 d = scratch.clippedFaces.back() - scratch.clippedFaces[start];
+        if (Vec3::dot(d, d) > 1e-12f) break;
+        scratch.clippedFaces.pop_back();
+      }
+      const size_t capSize = scratch.clippedFaces.size() - start;
+      if (capSize < 3)
+        scratch.clippedFaces.resize(start);
+      else
+        scratch.clippedFaceSizes.push_back(capSize);
+    }
   }
-  return v;
-}
 
-static std::vector<float> vec3toRaw(const std::vector<Vec3>& posData) {
-  std::vector<float> v(posData.size()*3);
-  for (size_t i = 0;i<posData.size();++i) {
-    v[i*3+0] = posData[i].x;
-    v[i*3+1] = posData[i].y;
-    v[i*3+2] = posData[i].z;
-  }
-  return v;
+  std::swap(scratch.faces, scratch.clippedFaces);
+  std::swap(scratch.faceSizes, scratch.clippedFaceSizes);
+  return true;
 }
 
-
-void Clipper::meshPlane(std::vector<Vec3>& posData, const Vec3 &normal, const float D) {
-
-  std::vector<Vec3> newVertices = Clipper::triPlane(posData, normal, D);
-
-  if (newVertices.size() < 3) return;
-  
-  // remove duplicate vertices
-  std::sort(newVertices.begin(), newVertices.end(), compSorter());
-  newVertices.erase(std::unique(newVertices.begin(), newVertices.end()),
-                    newVertices.end());
-
-  // sort counter clockwise
-  using namespace std::placeholders;
-
-  Vec3 center;
-  for (const Vec3& vertex : newVertices) {
-    center = center + vertex;
+void Clipper::meshBox(const Vec3& boxMin, const Vec3& boxMax,
+                      const Plane* planes, size_t planeCount,
+                      Scratch& scratch, std::vector<float>& triangles) {
+  scratch.faces.clear();
+  scratch.faceSizes.clear();
+
+  // the six faces of the box, counter clockwise seen from outside
+  const Vec3 corners[2] = {boxMin, boxMax};
+  for (size_t axis = 0;axis<3;++axis) {
+    const size_t u = (axis+1)%3;
+    const size_t v = (axis+2)%3;
+    for (size_t side = 0;side<2;++side) {
+      static const size_t order[2][4][2] = {{{0,0},{0,1},{1,1},{1,0}},
+                                            {{0,0},{1,0},{1,1},{0,1}}};
+      for (size_t i = 0;i<4;++i) {
+        Vec3 p;
+        p[axis] = corners[side][axis];
+        p[u] = corners[order[side][i][0]][u];
+        p[v] = corners[order[side][i][1]][v];
+        scratch.faces.push_back(p);
+      }
+      scratch.faceSizes.push_back(4);
+    }
   }
-  center = center / float(newVertices.size());
 
-  std::sort(newVertices.begin(), newVertices.end(), std::bind(angleSorter, _1, _2, center, Vec3::normalize(newVertices[0]-center), normal ));
-
-  // create a triangle fan with the newly created vertices to close the polytope
-  for (auto vertex = newVertices.begin()+2;vertex<newVertices.end();++vertex) {
-    posData.push_back(newVertices[0]);
-    posData.push_back(*(vertex-1));
-    posData.push_back(*(vertex));
+  for (size_t i = 0;i<planeCount;++i) clipPolytope(scratch, planes[i]);
+
+  // triangle fans
+  triangles.clear();
+  size_t first = 0;
+  for (const size_t faceSize : scratch.faceSizes) {
+    for (size_t i = 2;i<faceSize;++i) {
+      for (const size_t j : {first, first+i-1, first+i}) {
+        triangles.push_back(scratch.faces[j].x);
+        triangles.push_back(scratch.faces[j].y);
+        triangles.push_back(scratch.faces[j].z);
+      }
+    }
+    first += faceSize;
   }
-
-}
-
-std::vector<float> Clipper::meshPlane(std::vector<float> posData,
-                                     const Vec3 &normal, const float D) {
-  std::vector<Vec3> vecPos = rawToVec3(posData);
-  meshPlane(vecPos, normal, D);
-  return vec3toRaw(vecPos);
 }
@@ -1,15 +1,38 @@
 #pragma once
 
 #include <vector>
+#include <utility>
 #include <Vec3.h>
 
 class Clipper {
 public:
-  static std::vector<Vec3> triPlane(std::vector<Vec3>& posData,
-                                    const Vec3 &normal, const float D);
-  static void meshPlane(std::vector<Vec3>& posData, const Vec3 &normal,
-                       const float D);
+  // the plane dot(normal, p) + D = 0, points with a positive distance
+  // are clipped away
+  struct Plane {
+    Vec3 normal;
+    float D;
+  };
 
-  static std::vector<float> meshPlane(std::vector<float> posData, const Vec3 &normal,
-                       const float D);
+  // buffers meshBox works in, owned by the caller and reused from call
+  // to call, so once they have grown to the size of the polytope no
+  // further allocations happen
+  struct Scratch {
+    std::vector<Vec3> faces;
+    std::vector<size_t> faceSizes;
+    std::vector<Vec3> clippedFaces;
+    std::vector<size_t> clippedFaceSizes;
+    std::vector<std::pair<float, Vec3>> cap;
+  };
+
+  // clips the box [boxMin, boxMax] against all planes in one pass,
+  // closing every cut with a cap polygon, and writes the outward facing
+  // (counter clockwise) triangles as xyz floats to triangles
+  static void meshBox(const Vec3& boxMin, const Vec3& boxMax,
+                      const Plane* planes, size_t planeCount,
+                      Scratch& scratch, std::vector<float>& triangles);
+  // upper bound for the triangles meshBox writes, the polytope has at
+  // most 6+planeCount faces with at most 6+planeCount corners each
+  static size_t maxBoxTriangles(size_t planeCount) {
+    return (6+planeCount)*(4+planeCount);
+  }
 };
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "Volume.h"
+
+// coarse grid of min/max values over blocks of cellSize^3 voxels, used
+// to skip empty space while raycasting; each cell also covers the
+// neighboring voxel on every side, since trilinear samples inside the
+// cell can reach that far
+class MacroCellGrid {
+public:
+  MacroCellGrid() :
+    cellSize{0},
+    cellsX{0}, cellsY{0}, cellsZ{0}
+  {}
+
+  // the values are mapped with mapping, like the samples of the shader
+  template <typename T>
+  MacroCellGrid(const VolumeT<T>& volume, size_t cellSize=8,
+                const ValueMapping& mapping=ValueMapping{}) :
+    cellSize{cellSize},
+    cellsX{(volume.width+cellSize-1)/cellSize},
+    cellsY{(volume.height+cellSize-1)/cellSize},
+    cellsZ{(volume.depth+cellSize-1)/cellSize}
+  {
+    minValues.resize(getCellCount());
+    maxValues.resize(getCellCount());
+    if (getCellCount() == 0) return;
+
+    const T* voxels = volume.getData();
+    const size_t sliceSize = volume.width*volume.height;
+    const float normalization = mapping.scale/float(std::numeric_limits<T>::max());
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t cz = 0;cz<int64_t(cellsZ);++cz) {
+      const size_t z0 = std::max<size_t>(size_t(cz)*cellSize, 1)-1;
+      const size_t z1 = std::min((size_t(cz)+1)*cellSize+1, volume.depth);
+      for (size_t cy = 0;cy<cellsY;++cy) {
+        const size_t y0 = std::max<size_t>(cy*cellSize, 1)-1;
+        const size_t y1 = std::min((cy+1)*cellSize+1, volume.height);
+        for (size_t cx = 0;cx<cellsX;++cx) {
+          const size_t x0 = std::max<size_t>(cx*cellSize, 1)-1;
+          const size_t x1 = std::min((cx+1)*cellSize+1, volume.width);
+          T minVal = voxels[x0 + y0*volume.width + z0*sliceSize];
+          T maxVal = minVal;
+          for (size_t z = z0;z<z1;++z) {
+            for (size_t y = y0;y<y1;++y) {
+              const T* row = voxels + y*volume.width + z*sliceSize;
+              for (size_t x = x0;x<x1;++x) {
+                minVal = std::min(minVal, row[x]);
+                maxVal = std::max(maxVal, row[x]);
+              }
+            }
+          }
+          const size_t index = cx + cy*cellsX + size_t(cz)*cellsX*cellsY;
+          minValues[index] = float(minVal)*normalization + mapping.offset;
+          maxValues[index] = float(maxVal)*normalization + mapping.offset;
+        }
+      }
+    }
+  }
+
+  size_t cellSize;
+  size_t cellsX;
+  size_t cellsY;
+  size_t cellsZ;
+
+  // normalized to [0,1] like the values the shader samples
+  std::vector<float> minValues;
+  std::vector<float> maxValues;
+
+  size_t getCellCount() const {
+    return cellsX*cellsY*cellsZ;
+  }
+
+  // 255 for every cell in which the smoothstep transfer function of
+  // cubeFS.glsl yields a non-zero opacity, 0 for cells that can be
+  // skipped; the function is monotonic, so checking the range end
+  // points suffices
+  std::vector<uint8_t> computeOccupancy(float smoothStepStart,
+                                        float smoothStepWidth) const {
+    std::vector<uint8_t> occupancy(getCellCount());
+    for (size_t i = 0;i<occupancy.size();++i) {
+      const float a = (minValues[i]-smoothStepStart)/smoothStepWidth;
+      const float b = (maxValues[i]-smoothStepStart)/smoothStepWidth;
+      occupancy[i] = (a > 0.0f || b > 0.0f) ? 255 : 0;
+    }
+    return occupancy;
+  }
+};
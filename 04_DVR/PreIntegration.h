@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <Vec4.h>
+
+// pre-integrated transfer function: entry (front, back) holds color and
+// opacity of a ray segment of segmentLength between two consecutive
+// samples with these values, assuming the scalar varies linearly along
+// the segment; segment lengths are measured like opacityCorrection in
+// cubeFS.glsl, other lengths are handled by the usual opacity correction
+// 1-(1-a)^(length/segmentLength)
+class PreIntegrationTable {
+public:
+  PreIntegrationTable() :
+    size{0},
+    segmentLength{1.0f}
+  {}
+
+  // transferFunction holds rgb and the opacity of a segment of length 1
+  // at equally spaced values over [0,1], the table has the same
+  // resolution
+  PreIntegrationTable(const std::vector<Vec4>& transferFunction, float segmentLength) :
+    size{transferFunction.size()},
+    segmentLength{segmentLength},
+    data(transferFunction.size()*transferFunction.size()*4, 0.0f)
+  {
+    if (size == 0) return;
+
+    // prefix integrals (trapezoid rule) of the extinction and of the
+    // extinction weighted color, the optical depth from the front of a
+    // segment to any point on it is a difference of two entries
+    const double h = (size > 1) ? 1.0/double(size-1) : 1.0;
+    std::vector<double> tau(size);
+    for (size_t i = 0;i<size;++i) tau[i] = extinction(transferFunction[i].w);
+
+    std::vector<double> integralTau(size, 0.0);
+    std::vector<double> integralColor(size*3, 0.0);
+    for (size_t i = 1;i<size;++i) {
+      const Vec4& c0 = transferFunction[i-1];
+      const Vec4& c1 = transferFunction[i];
+      integralTau[i] = integralTau[i-1] + 0.5*h*(tau[i-1]+tau[i]);
+      for (size_t c = 0;c<3;++c)
+        integralColor[i*3+c] = integralColor[(i-1)*3+c] +
+                               0.5*h*(tau[i-1]*double(c0[c])+tau[i]*double(c1[c]));
+    }
+
+    // extinction weighted average color of each cell between two entries
+    std::vector<double> cellColor((size-1)*3);
+    for (size_t k = 0;k+1<size;++k) {
+      const double cellTau = integralTau[k+1]-integralTau[k];
+      for (size_t c = 0;c<3;++c)
+        cellColor[k*3+c] = (cellTau > 1e-12)
+          ? (integralColor[(k+1)*3+c]-integralColor[k*3+c])/cellTau
+          : 0.5*(double(transferFunction[k][c])+double(transferFunction[k+1][c]));
+    }
+
+    for (size_t f = 0;f<size;++f) {
+      const Vec4& e = transferFunction[f];
+      float* entry = data.data() + (f + f*size)*4;
+      entry[0] = e.x; entry[1] = e.y; entry[2] = e.z;
+      entry[3] = float(1.0-std::exp(-double(segmentLength)*tau[f]));
+    }
+    integrateSegments(transferFunction, integralTau, cellColor, h, false);
+    integrateSegments(transferFunction, integralTau, cellColor, h, true);
+  }
+
+  // the smoothstep gray ramp of cubeFS.glsl sampled at count values
+  static std::vector<Vec4> smoothStep(float start, float width, size_t count=256) {
+    std::vector<Vec4> transferFunction(count);
+    for (size_t i = 0;i<count;++i) {
+      const float s = (count > 1) ? float(i)/float(count-1) : 0.0f;
+      float v = std::min(std::max((s-start)/width, 0.0f), 1.0f);
+      v = v*v*(3.0f-2.0f*v);
+      transferFunction[i] = Vec4{v, v, v, v};
+    }
+    return transferFunction;
+  }
+
+  // bilinear lookup, matches a GL_LINEAR texture accessed at the texel
+  // centers (value*(size-1)+0.5)/size
+  Vec4 lookup(float front, float back) const {
+    const float fx = std::min(std::max(front, 0.0f), 1.0f)*float(size-1);
+    const float fy = std::min(std::max(back, 0.0f), 1.0f)*float(size-1);
+    const size_t x0 = size_t(fx), y0 = size_t(fy);
+    const size_t x1 = std::min(x0+1, size-1), y1 = std::min(y0+1, size-1);
+    const float ax = fx-float(x0), ay = fy-float(y0);
+    Vec4 result;
+    for (size_t c = 0;c<4;++c) {
+      const float c0 = data[(x0+y0*size)*4+c]*(1-ax) + data[(x1+y0*size)*4+c]*ax;
+      const float c1 = data[(x0+y1*size)*4+c]*(1-ax) + data[(x1+y1*size)*4+c]*ax;
+      result[c] = c0*(1-ay) + c1*ay;
+    }
+    return result;
+  }
+
+  size_t size;
+  float segmentLength;
+  // rgba floats, front value along x, back value along y
+  std::vector<float> data;
+
+private:
+  // fills the entries whose back value lies above the front value, with
+  // reversed the value axis is mirrored, which fills those below. A
+  // segment passes the cells between front and back, the share of a cell
+  // is the transparency in front of it minus the transparency behind it.
+  // All segments spanning the same number of cells share the depth scale,
+  // so along each such diagonal the sum over the cells slides from one
+  // front value to the next in constant time
+  void integrateSegments(const std::vector<Vec4>& transferFunction,
+                         const std::vector<double>& integralTau,
+                         const std::vector<double>& cellColor,
+                         double h, bool reversed) {
+    const auto optical = [&](size_t i) {
+      return reversed ? integralTau[size-1]-integralTau[size-1-i] : integralTau[i];
+    };
+    const auto color = [&](size_t k, size_t c) {
+      return reversed ? cellColor[(size-2-k)*3+c] : cellColor[k*3+c];
+    };
+    const auto value = [&](size_t i) {return reversed ? size-1-i : i;};
+
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t n = 1;n<int64_t(size);++n) {
+      const size_t cells = size_t(n);
+      const double depthScale = double(segmentLength)/(double(cells)*h);
+      const auto transparency = [&](size_t front, size_t i) {
+        return std::exp(-depthScale*(optical(i)-optical(front)));
+      };
+
+      // sum for the last front value, then slide the window of cells
+      // down by dropping its back cell and adding one in front
+      size_t f = size-1-cells;
+      double sum[3] = {0.0, 0.0, 0.0};
+      for (size_t k = f;k<f+cells;++k) {
+        const double share = transparency(f, k)-transparency(f, k+1);
+        for (size_t c = 0;c<3;++c) sum[c] += share*color(k, c);
+      }
+      while (true) {
+        const size_t b = f+cells;
+        const double alpha = 1.0-transparency(f, b);
+        float* entry = data.data() + (value(f) + value(b)*size)*4;
+        for (size_t c = 0;c<3;++c)
+          entry[c] = (alpha > 1e-12)
+            ? float(sum[c]/alpha)
+            : 0.5f*(transferFunction[value(f)][c]+transferFunction[value(b)][c]);
+        entry[3] = float(alpha);
+        if (f == 0) break;
+
+        --f;
+        const size_t last = f+cells;
+        const double dropped = transparency(f+1, last)-transparency(f+1, last+1);
+        const double first = transparency(f, f+1);
+        for (size_t c = 0;c<3;++c)
+          sum[c] = first*(sum[c]-dropped*color(last, c)) + (1.0-first)*color(f, c);
+      }
+    }
+  }
+
+  // a fully opaque sample has infinite extinction, the cap still makes
+  // any segment through it opaque at all practical step lengths
+  static double extinction(float opacity) {
+    const double maxExtinction = 1000.0;
+    if (opacity >= 1.0f) return maxExtinction;
+    return std::min(-std::log(1.0-double(opacity)), maxExtinction);
+  }
+};
@@ -5,11 +5,22 @@
 
 #include "QVis.h"
 
-QVis::QVis(const std::string& filename) {
-  load(filename);
+QVis::QVis(const std::string& filename, bool memoryMapped, bool keep16Bit) {
+  load(filename, memoryMapped, keep16Bit);
 }
 
-void QVis::load(const std::string& filename) {
+void QVis::load(const std::string& filename, bool memoryMapped,
+                bool keep16Bit) {
+  pyramid.clear();
+  pyramid16.clear();
+  volume = Volume{};
+  volume16 = Volume16{};
+
+  if (VolumeContainer::isContainer(filename)) {
+    loadContainer(filename, keep16Bit);
+    return;
+  }
+
   std::ifstream datfile(filename);
   if (!datfile) throw QVisFileException{std::string("Unable to read file ")+filename};
 
@@ -67,30 +78,105 @@ void QVis::load(const std::string& filename) {
   if (rawFilename.empty())
     throw QVisFileException{"object filename not found"};
 
-  std::ifstream rawFile( rawFilename, std::ios::binary );
+  const size_t voxelCount = volume.getVoxelCount();
+  const size_t rawSize = voxelCount * (needsConversion ? 2 : 1);
 
-  if (needsConversion) {
-    // if it's not 8bit, we assume 16bit
-    const std::vector<uint16_t> data(volume.width*volume.height*volume.depth);
-    rawFile.read((char*)data.data(), std::streamsize(volume.width*volume.height*volume.depth*2));
-    uint16_t minVal = data[0], maxVal = data[0];
+  if (needsConversion && keep16Bit) {
+    loadNative16Bit(rawFilename, memoryMapped);
+    return;
+  }
 
-    for (uint16_t val : data ) {
-      minVal = std::min(minVal, val);
-      maxVal = std::max(maxVal, val);
+  if (memoryMapped) {
+    std::shared_ptr<MappedFile> mappedFile;
+    try {
+      mappedFile = std::make_shared<MappedFile>(rawFilename);
+    } catch (const MappedFileException& e) {
+      throw QVisFileException{e.what()};
     }
-    volume.data.resize(data.size());
-
-    for (size_t i = 0;i<data.size();++i) {
-      volume.data[i] = uint8_t(((data[i]-minVal)*255) / (1+maxVal-minVal));
+    if (mappedFile->getSize() < rawSize)
+      throw QVisFileException{std::string("raw file too small ")+rawFilename};
+
+    if (needsConversion) {
+      // the 16bit data still needs to be squashed into 8bit, but the
+      // mapping spares us the intermediate copy of the raw data
+      volume.data.resize(voxelCount);
+      quantize16to8((const uint16_t*)mappedFile->getData(),
+                    volume.data.data(), voxelCount);
+    } else {
+      volume.mappedFile = mappedFile;
     }
+  } else {
+    std::ifstream rawFile( rawFilename, std::ios::binary );
+
+    if (needsConversion) {
+      // if it's not 8bit, we assume 16bit
+      std::vector<uint16_t> data(voxelCount);
+      rawFile.read((char*)data.data(), std::streamsize(rawSize));
+      volume.data.resize(voxelCount);
+      quantize16to8(data.data(), volume.data.data(), voxelCount);
+    } else {
+      volume.data.resize(voxelCount);
+      rawFile.read((char*)volume.data.data(), std::streamsize(rawSize));
+    }
+    rawFile.close();
+  }
+}
+
+void QVis::loadNative16Bit(const std::string& rawFilename, bool memoryMapped) {
+  volume16.setLayout(volume);
+  volume = Volume{};
 
+  const size_t voxelCount = volume16.getVoxelCount();
+  if (memoryMapped) {
+    try {
+      volume16.mappedFile = std::make_shared<MappedFile>(rawFilename);
+    } catch (const MappedFileException& e) {
+      throw QVisFileException{e.what()};
+    }
+    if (volume16.mappedFile->getSize() < voxelCount*2)
+      throw QVisFileException{std::string("raw file too small ")+rawFilename};
   } else {
-    volume.data = std::vector<uint8_t>(std::istreambuf_iterator<char>(rawFile), {});
+    std::ifstream rawFile( rawFilename, std::ios::binary );
+    volume16.data.resize(voxelCount);
+    rawFile.read((char*)volume16.data.data(), std::streamsize(voxelCount*2));
+    rawFile.close();
+  }
+}
+
+void QVis::loadContainer(const std::string& filename, bool keep16Bit) {
+  try {
+    const VolumeContainer container{filename};
+    if (container.bytesPerVoxel == 1) {
+      volume = container.readVolume<uint8_t>();
+    } else if (keep16Bit) {
+      volume16 = container.readVolume<uint16_t>();
+    } else {
+      Volume16 source = container.readVolume<uint16_t>();
+      volume = quantize16to8(source);
+      volume.compactNormals = std::move(source.compactNormals);
+    }
+  } catch (const VolumeContainerException& e) {
+    throw QVisFileException{e.what()};
   }
-  rawFile.close();
+}
+
+void QVis::save(const std::string& filename, size_t brickSize,
+                bool withNormals) const {
+  try {
+    if (is16Bit())
+      VolumeContainer::write(filename, volume16, brickSize, withNormals);
+    else
+      VolumeContainer::write(filename, volume, brickSize, withNormals);
+  } catch (const VolumeContainerException& e) {
+    throw QVisFileException{e.what()};
+  }
+}
 
-  volume.computeNormals();
+void QVis::buildPyramid(size_t minSize) {
+  if (is16Bit())
+    pyramid16 = volume16.createPyramid(minSize);
+  else
+    pyramid = volume.createPyramid(minSize);
 }
 
 std::vector<std::string> QVis::tokenize(const std::string& str) const {
@@ -3,12 +3,30 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <memory>
+#include <limits>
+#include <algorithm>
 
 #include <Vec3.h>
+#include <MappedFile.h>
+#include <Octahedral.h>
 
-class Volume {
+enum class NormalFormat {
+  Float,        // one Vec3 per voxel (12 bytes)
+  Octahedral16  // two 8bit octahedral components per voxel (2 bytes)
+};
+
+enum class ResampleFilter {
+  Trilinear,  // interpolates at the target voxel centers
+  Box         // averages all source voxels a target voxel covers
+};
+
+template <typename T>
+class VolumeT {
 public:
-  Volume() :
+  typedef T ValueType;
+
+  VolumeT() :
     width{0}, height{0}, depth{0},
     scale{0.0f, 0.0f, 0.0f}
   {}
@@ -19,8 +37,23 @@ public:
   size_t maxSize;
   Vec3 scale;
 
-  std::vector<uint8_t> data;
+  std::vector<T> data;
   std::vector<Vec3> normals;
+  // octahedral encoded normals, filled instead of normals when
+  // computeNormals is called with NormalFormat::Octahedral16
+  std::vector<uint16_t> compactNormals;
+
+  // when set, the voxels are not copied into data but read
+  // directly from the memory mapped raw file
+  std::shared_ptr<MappedFile> mappedFile;
+
+  const T* getData() const {
+    return mappedFile ? (const T*)mappedFile->getData() : data.data();
+  }
+
+  size_t getVoxelCount() const {
+    return width*height*depth;
+  }
   
   void normalizeScale() {
     maxSize = std::max(width,std::max(height,depth));
@@ -29,91 +62,450 @@ public:
     scale = scale / m;
   }
 
-  Volume resample(size_t targetWidth, size_t targetHeight, size_t targetDepth) {
-    Volume result;
+  template <typename U>
+  void setLayout(const VolumeT<U>& other) {
+    width = other.width;
+    height = other.height;
+    depth = other.depth;
+    maxSize = other.maxSize;
+    scale = other.scale;
+  }
+
+  VolumeT resample(size_t targetWidth, size_t targetHeight, size_t targetDepth,
+                   ResampleFilter filter=ResampleFilter::Trilinear) const {
+    VolumeT result = createResampleTarget(targetWidth, targetHeight, targetDepth);
+    if (result.getVoxelCount() == 0 || getVoxelCount() == 0) return result;
+    resampleSlices(result, depth, 0, 0, result.depth, filter);
+    return result;
+  }
+
+  // allocated volume with the layout resample would produce
+  VolumeT createResampleTarget(size_t targetWidth, size_t targetHeight,
+                               size_t targetDepth) const {
+    VolumeT result;
     result.width = targetWidth;
     result.height = targetHeight;
     result.depth = targetDepth;
     result.scale = scale;
+    if (result.getVoxelCount() == 0 || getVoxelCount() == 0) return result;
+
+    // keep the physical extent, the voxel spacing follows the new size
+    result.scale = scale * Vec3{float(width)/float(targetWidth),
+                                float(height)/float(targetHeight),
+                                float(depth)/float(targetDepth)};
     result.normalizeScale();
+    result.data.resize(result.getVoxelCount());
+    return result;
+  }
 
-    result.data.resize(result.width*result.height*result.depth);
+  // fills the target slices [targetStart, targetEnd) of result, where
+  // this volume only holds the slices starting at sourceOffset of a
+  // volume that is sourceDepth slices deep; sourceRange tells which
+  // slices that have to be, so large volumes can be resampled slab-wise
+  void resampleSlices(VolumeT& result, size_t sourceDepth, size_t sourceOffset,
+                      size_t targetStart, size_t targetEnd,
+                      ResampleFilter filter) const {
+    if (filter == ResampleFilter::Trilinear)
+      resampleTrilinear(result, sourceDepth, sourceOffset, targetStart, targetEnd);
+    else
+      resampleBox(result, sourceDepth, sourceOffset, targetStart, targetEnd);
+  }
 
-    size_t targetIndex{0};
-    for (size_t w = 0;w<result.depth;++w) {
-      for (size_t v = 0;v<result.height;++v) {
-        for (size_t u = 0;u<result.width;++u) {
-          const uint8_t value = sample(float(u)/float(result.width),
-                                       float(v)/float(result.height),
-                                       float(w)/float(result.depth));
-          result.data[targetIndex++] = value;
-        }
+  static void sourceRange(size_t sourceDepth, size_t targetDepth,
+                          size_t targetStart, size_t targetEnd,
+                          ResampleFilter filter, size_t& begin, size_t& end) {
+    begin = sourceDepth;
+    end = 0;
+    if (filter == ResampleFilter::Trilinear) {
+      const std::vector<LinearTap> taps = linearTaps(sourceDepth, targetDepth);
+      for (size_t i = targetStart;i<targetEnd;++i) {
+        begin = std::min(begin, taps[i].i0);
+        end = std::max(end, taps[i].i1+1);
+      }
+    } else {
+      const std::vector<BoxTap> taps = boxTaps(sourceDepth, targetDepth);
+      for (size_t i = targetStart;i<targetEnd;++i) {
+        begin = std::min(begin, taps[i].start);
+        end = std::max(end, taps[i].end);
       }
     }
+  }
 
-    return result;
+  // successively halved box filtered copies of the volume, the first
+  // entry has half the resolution of this volume and the last one is
+  // no larger than minSize in any dimension
+  std::vector<VolumeT> createPyramid(size_t minSize=1) const {
+    std::vector<VolumeT> levels;
+    minSize = std::max<size_t>(minSize, 1);
+    while (true) {
+      const VolumeT& current = levels.empty() ? *this : levels.back();
+      if (std::max(current.width, std::max(current.height, current.depth)) <= minSize)
+        break;
+      levels.push_back(current.resample((current.width+1)/2,
+                                        (current.height+1)/2,
+                                        (current.depth+1)/2,
+                                        ResampleFilter::Box));
+    }
+    return levels;
   }
-  
+
   std::string toString() const {
     std::stringstream ss;
     ss << "width: " << width << "\n";
     ss << "height: " << height << "\n";
     ss << "depth: " << depth << "\n";
-    ss << "dataseize: " << data.size() << "\n";
+    ss << "dataseize: " << getVoxelCount() << "\n";
     ss << "scale: " << scale << "\n";
-    
-    for (size_t i = 0;i<data.size();++i) {
+
+    const T* voxels = getData();
+    for (size_t i = 0;i<getVoxelCount();++i) {
       if (i > 0 && i % width == 0) ss << "\n";
       if (i > 0 && i % (width*height) == 0) ss << "\n";
-      ss << int(data[i]) << " ";
+      ss << int(voxels[i]) << " ";
     }
     
     return ss.str();
   }
   
-  void computeNormals() {
-    normals.resize(data.size());
-    for (size_t w = 1;w<depth-1;++w) {
-      for (size_t v = 1;v<height-1;++v) {
-        for (size_t u = 1;u<width-1;++u) {
-          const size_t index = u + v * width + w * width * height;
-          const Vec3 normal{
-            float(data[index-1]) - float(data[index+1]),
-            float(data[index-width]) - float(data[index+width]),
-            float(data[index-width*height]) - float(data[index+width*height])
-          };
-          normals[index] = Vec3::normalize(normal);
+  bool hasNormals() const {
+    return !normals.empty() || !compactNormals.empty();
+  }
+
+  // normals are not computed on load, consumers either request the
+  // whole field via computeNormals or only the few they actually need
+  // through getNormal, which falls back to on-the-fly differences
+  Vec3 getNormal(size_t u, size_t v, size_t w) const {
+    const size_t index = u + v * width + w * width * height;
+    if (!compactNormals.empty())
+      return Octahedral::decode16(compactNormals[index]);
+    if (!normals.empty())
+      return normals[index];
+    return computeNormal(u, v, w);
+  }
+
+  // central differences, one-sided at the border of the volume
+  Vec3 computeNormal(size_t u, size_t v, size_t w) const {
+    const size_t u0 = u > 0 ? u-1 : u, u1 = u+1 < width  ? u+1 : u;
+    const size_t v0 = v > 0 ? v-1 : v, v1 = v+1 < height ? v+1 : v;
+    const size_t w0 = w > 0 ? w-1 : w, w1 = w+1 < depth  ? w+1 : w;
+    const Vec3 normal{
+      float(getValue(u0,v,w)) - float(getValue(u1,v,w)),
+      float(getValue(u,v0,w)) - float(getValue(u,v1,w)),
+      float(getValue(u,v,w0)) - float(getValue(u,v,w1))
+    };
+    return Vec3::normalize(normal);
+  }
+
+  // central differences, computed in parallel over z-slabs; every row
+  // goes through SoA scratch arrays so the inner loops vectorize
+  void computeNormals(NormalFormat format=NormalFormat::Float) {
+    const T* voxels = getData();
+    normals.clear();
+    compactNormals.clear();
+    if (format == NormalFormat::Float)
+      normals.resize(getVoxelCount());
+    else
+      compactNormals.resize(getVoxelCount());
+
+    // the border gets the same one-sided differences getNormal derives
+    // on the fly, so a voxel's normal does not depend on whether the
+    // field was precomputed
+    const auto storeBorder = [this, format](size_t u, size_t v, size_t w) {
+      const size_t index = u + v*width + w*width*height;
+      if (format == NormalFormat::Float)
+        normals[index] = computeNormal(u, v, w);
+      else
+        compactNormals[index] = Octahedral::encode16(computeNormal(u, v, w));
+    };
+#pragma omp parallel for schedule(static)
+    for (int64_t w = 0;w<int64_t(depth);++w) {
+      const bool borderSlice = w == 0 || w+1 == int64_t(depth);
+      for (size_t v = 0;v<height;++v) {
+        if (borderSlice || v == 0 || v+1 == height) {
+          for (size_t u = 0;u<width;++u) storeBorder(u, v, size_t(w));
+        } else {
+          storeBorder(0, v, size_t(w));
+          if (width > 1) storeBorder(width-1, v, size_t(w));
+        }
+      }
+    }
+
+    if (width < 3 || height < 3 || depth < 3) return;
+
+    const size_t sliceSize = width*height;
+    const int64_t lastSlice = int64_t(depth)-1;
+#pragma omp parallel
+    {
+      std::vector<float> gx(width), gy(width), gz(width);
+#pragma omp for schedule(static)
+      for (int64_t w = 1;w<lastSlice;++w) {
+        for (size_t v = 1;v<height-1;++v) {
+          const size_t rowStart = size_t(w)*sliceSize + v*width;
+          const T* row = voxels + rowStart;
+          const T* rowBelow = row - width;
+          const T* rowAbove = row + width;
+          const T* rowFront = row - sliceSize;
+          const T* rowBack = row + sliceSize;
+
+          for (size_t u = 1;u<width-1;++u) {
+            gx[u] = float(row[u-1]) - float(row[u+1]);
+            gy[u] = float(rowBelow[u]) - float(rowAbove[u]);
+            gz[u] = float(rowFront[u]) - float(rowBack[u]);
+          }
+          for (size_t u = 1;u<width-1;++u) {
+            const float l = sqrtf(gx[u]*gx[u] + gy[u]*gy[u] + gz[u]*gz[u]);
+            const float s = (l != 0.0f) ? 1.0f/l : 0.0f;
+            gx[u] *= s;
+            gy[u] *= s;
+            gz[u] *= s;
+          }
+
+          if (format == NormalFormat::Float) {
+            for (size_t u = 1;u<width-1;++u)
+              normals[rowStart+u] = Vec3{gx[u],gy[u],gz[u]};
+          } else {
+            for (size_t u = 1;u<width-1;++u)
+              compactNormals[rowStart+u] = Octahedral::encode16(Vec3{gx[u],gy[u],gz[u]});
+          }
         }
       }
     }
   }
 
 private:
-  uint8_t sample(float u, float v, float w) {
-    Vec3 voxelIndex{u*width-1, v*height-1, w*depth-1};
+  // source voxels and weight used to reconstruct one target coordinate
+  struct LinearTap {
+    size_t i0;
+    size_t i1;
+    float alpha;
+  };
+
+  // source voxel range covered by one target coordinate
+  struct BoxTap {
+    size_t start;
+    size_t end;
+  };
 
-    const Vec3 f{floor(voxelIndex.x),floor(voxelIndex.y),floor(voxelIndex.z)};
-    const Vec3 alpha{voxelIndex-f};
+  // target voxel centers are mapped onto the source voxel centers
+  static std::vector<LinearTap> linearTaps(size_t sourceSize, size_t targetSize) {
+    std::vector<LinearTap> taps(targetSize);
+    const float ratio = float(sourceSize)/float(targetSize);
+    const float last = float(sourceSize-1);
+    for (size_t i = 0;i<targetSize;++i) {
+      const float x = std::min(std::max((float(i)+0.5f)*ratio-0.5f, 0.0f), last);
+      const size_t i0 = size_t(x);
+      taps[i] = LinearTap{i0, std::min(i0+1, sourceSize-1), x-float(i0)};
+    }
+    return taps;
+  }
+
+  static std::vector<BoxTap> boxTaps(size_t sourceSize, size_t targetSize) {
+    std::vector<BoxTap> taps(targetSize);
+    for (size_t i = 0;i<targetSize;++i) {
+      const size_t start = std::min(i*sourceSize/targetSize, sourceSize-1);
+      const size_t end = std::max(start+1, (i+1)*sourceSize/targetSize);
+      taps[i] = BoxTap{start, std::min(end, sourceSize)};
+    }
+    return taps;
+  }
 
-    const float v0 = getValue(size_t(f.x)+0,size_t(f.y)+0,size_t(f.z)+0);
-    const float v1 = getValue(size_t(f.x)+1,size_t(f.y)+0,size_t(f.z)+0);
-    const float v2 = getValue(size_t(f.x)+0,size_t(f.y)+1,size_t(f.z)+0);
-    const float v3 = getValue(size_t(f.x)+1,size_t(f.y)+1,size_t(f.z)+0);
-    const float v4 = getValue(size_t(f.x)+0,size_t(f.y)+0,size_t(f.z)+1);
-    const float v5 = getValue(size_t(f.x)+1,size_t(f.y)+0,size_t(f.z)+1);
-    const float v6 = getValue(size_t(f.x)+0,size_t(f.y)+1,size_t(f.z)+1);
-    const float v7 = getValue(size_t(f.x)+1,size_t(f.y)+1,size_t(f.z)+1);
+  // separable: the four source rows around a target row are blended
+  // in y and z first, then the blended row is interpolated along x
+  void resampleTrilinear(VolumeT& result, size_t sourceDepth, size_t sourceOffset,
+                         size_t targetStart, size_t targetEnd) const {
+    const std::vector<LinearTap> xTaps = linearTaps(width, result.width);
+    const std::vector<LinearTap> yTaps = linearTaps(height, result.height);
+    const std::vector<LinearTap> zTaps = linearTaps(sourceDepth, result.depth);
+    const T* voxels = getData();
+    const size_t sliceSize = width*height;
+    const size_t targetSliceSize = result.width*result.height;
 
-    return uint8_t(
-             (((v0*(1-alpha.x) + v1*alpha.x) * (1-alpha.y) +
-               (v2*(1-alpha.x) + v3*alpha.x) * alpha.y)) * (1-alpha.z) +
+#pragma omp parallel
+    {
+      std::vector<float> row(width);
+#pragma omp for schedule(static)
+      for (int64_t w = int64_t(targetStart);w<int64_t(targetEnd);++w) {
+        const LinearTap& tz = zTaps[size_t(w)];
+        const T* slice0 = voxels + (tz.i0-sourceOffset)*sliceSize;
+        const T* slice1 = voxels + (tz.i1-sourceOffset)*sliceSize;
+        for (size_t v = 0;v<result.height;++v) {
+          const LinearTap& ty = yTaps[v];
+          const T* r00 = slice0 + ty.i0*width;
+          const T* r01 = slice0 + ty.i1*width;
+          const T* r10 = slice1 + ty.i0*width;
+          const T* r11 = slice1 + ty.i1*width;
+          const float w00 = (1.0f-ty.alpha)*(1.0f-tz.alpha);
+          const float w01 = ty.alpha*(1.0f-tz.alpha);
+          const float w10 = (1.0f-ty.alpha)*tz.alpha;
+          const float w11 = ty.alpha*tz.alpha;
+          for (size_t u = 0;u<width;++u)
+            row[u] = float(r00[u])*w00 + float(r01[u])*w01 +
+                     float(r10[u])*w10 + float(r11[u])*w11;
 
-             (((v4*(1-alpha.x) + v5*alpha.x) * (1-alpha.y) +
-               (v6*(1-alpha.x) + v7*alpha.x) * alpha.y)) * alpha.z);
+          T* target = result.data.data() + v*result.width + size_t(w)*targetSliceSize;
+          for (size_t u = 0;u<result.width;++u) {
+            const LinearTap& tx = xTaps[u];
+            target[u] = T(row[tx.i0]*(1.0f-tx.alpha) + row[tx.i1]*tx.alpha + 0.5f);
+          }
+        }
+      }
+    }
+  }
+
+  // averages every source voxel within the footprint of a target voxel,
+  // again summing whole rows first and reducing along x afterwards
+  void resampleBox(VolumeT& result, size_t sourceDepth, size_t sourceOffset,
+                   size_t targetStart, size_t targetEnd) const {
+    const std::vector<BoxTap> xTaps = boxTaps(width, result.width);
+    const std::vector<BoxTap> yTaps = boxTaps(height, result.height);
+    const std::vector<BoxTap> zTaps = boxTaps(sourceDepth, result.depth);
+    const T* voxels = getData();
+    const size_t sliceSize = width*height;
+    const size_t targetSliceSize = result.width*result.height;
+
+#pragma omp parallel
+    {
+      std::vector<float> row(width);
+#pragma omp for schedule(static)
+      for (int64_t w = int64_t(targetStart);w<int64_t(targetEnd);++w) {
+        const BoxTap& tz = zTaps[size_t(w)];
+        for (size_t v = 0;v<result.height;++v) {
+          const BoxTap& ty = yTaps[v];
+          std::fill(row.begin(), row.end(), 0.0f);
+          for (size_t z = tz.start;z<tz.end;++z) {
+            for (size_t y = ty.start;y<ty.end;++y) {
+              const T* source = voxels + y*width + (z-sourceOffset)*sliceSize;
+              for (size_t u = 0;u<width;++u)
+                row[u] += float(source[u]);
+            }
+          }
+          const float yzCount = float((ty.end-ty.start)*(tz.end-tz.start));
+
+          T* target = result.data.data() + v*result.width + size_t(w)*targetSliceSize;
+          for (size_t u = 0;u<result.width;++u) {
+            const BoxTap& tx = xTaps[u];
+            float sum = 0.0f;
+            for (size_t x = tx.start;x<tx.end;++x)
+              sum += row[x];
+            target[u] = T(sum/(yzCount*float(tx.end-tx.start)) + 0.5f);
+          }
+        }
+      }
+    }
   }
 
-  uint8_t getValue(size_t u, size_t v, size_t w) {
+  T getValue(size_t u, size_t v, size_t w) const {
     const size_t index = u + v * width + w * width * height;
-    return data[index];
+    return getData()[index];
+  }
+};
+
+typedef VolumeT<uint8_t> Volume;
+typedef VolumeT<uint16_t> Volume16;
+
+// smallest and largest of count samples, scanned chunk-parallel with
+// branch-free inner loops the compiler can vectorize
+template <typename T>
+inline void valueRange(const T* source, size_t count, T& minValue, T& maxValue) {
+  minValue = maxValue = 0;
+  if (count == 0) return;
+
+  const int64_t chunkSize = 1<<16;
+  const int64_t chunkCount = int64_t((count+size_t(chunkSize)-1)/size_t(chunkSize));
+
+  std::vector<T> chunkMin(static_cast<size_t>(chunkCount));
+  std::vector<T> chunkMax(static_cast<size_t>(chunkCount));
+#pragma omp parallel for
+  for (int64_t c = 0;c<chunkCount;++c) {
+    const size_t start = size_t(c*chunkSize);
+    const size_t end = std::min(count, start+size_t(chunkSize));
+    T minVal = source[start], maxVal = source[start];
+    for (size_t i = start;i<end;++i) {
+      minVal = std::min(minVal, source[i]);
+      maxVal = std::max(maxVal, source[i]);
+    }
+    chunkMin[size_t(c)] = minVal;
+    chunkMax[size_t(c)] = maxVal;
   }
+  minValue = *std::min_element(chunkMin.begin(), chunkMin.end());
+  maxValue = *std::max_element(chunkMax.begin(), chunkMax.end());
+}
+
+// value*scale+offset takes a sample normalized by the maximum of its
+// type to [0,1] over the range the data set actually uses
+struct ValueMapping {
+  float scale{1.0f};
+  float offset{0.0f};
 };
+
+// 16bit data is stretched over its value range just like
+// quantize16to8 does when squashing it into 8bit, so both cover the
+// same range; 8bit data is used as it is
+template <typename T>
+inline ValueMapping computeValueMapping(const VolumeT<T>& volume) {
+  ValueMapping mapping;
+  if (sizeof(T) == 1) return mapping;
+  T minVal, maxVal;
+  valueRange(volume.getData(), volume.getVoxelCount(), minVal, maxVal);
+  const float range = 1.0f+float(maxVal)-float(minVal);
+  mapping.scale = float(std::numeric_limits<T>::max())/range;
+  mapping.offset = -float(minVal)/range;
+  return mapping;
+}
+
+// rescales 16bit samples from [minValue, maxValue] linearly into 8bit,
+// chunk-parallel with a branch-free inner loop the compiler can
+// vectorize; with the range of a whole volume its slabs can be
+// converted one at a time
+inline void quantize16to8(const uint16_t* source, uint8_t* target, size_t count,
+                          uint16_t minValue, uint16_t maxValue) {
+  if (count == 0) return;
+
+  const int64_t chunkSize = 1<<16;
+  const int64_t chunkCount = int64_t((count+size_t(chunkSize)-1)/size_t(chunkSize));
+
+  const int32_t minVal = minValue;
+  const int32_t maxVal = maxValue;
+
+  // same result as the integer expression ((x-min)*255)/(1+max-min),
+  // computed with a float reciprocal and an exact integer correction
+  const int32_t range = 1+maxVal-minVal;
+  const float scale = 255.0f/float(range);
+#pragma omp parallel for
+  for (int64_t c = 0;c<chunkCount;++c) {
+    const size_t start = size_t(c*chunkSize);
+    const size_t end = std::min(count, start+size_t(chunkSize));
+    for (size_t i = start;i<end;++i) {
+      const int32_t delta = int32_t(source[i])-minVal;
+      const int32_t n = delta*255;
+      int32_t q = int32_t(float(delta)*scale);
+      q += ((q+1)*range <= n) ? 1 : 0;
+      q -= (q*range > n) ? 1 : 0;
+      target[i] = uint8_t(q);
+    }
+  }
+}
+
+// the same over the value range of the samples themselves
+inline void quantize16to8(const uint16_t* source, uint8_t* target, size_t count) {
+  uint16_t minValue, maxValue;
+  valueRange(source, count, minValue, maxValue);
+  quantize16to8(source, target, count, minValue, maxValue);
+}
+
+inline Volume quantize16to8(const Volume16& source) {
+  Volume result;
+  result.setLayout(source);
+  result.data.resize(source.getVoxelCount());
+  quantize16to8(source.getData(), result.data.data(), result.data.size());
+  return result;
+}
+
+inline Volume quantize16to8(const Volume16& source, uint16_t minValue, uint16_t maxValue) {
+  Volume result;
+  result.setLayout(source);
+  result.data.resize(source.getVoxelCount());
+  quantize16to8(source.getData(), result.data.data(), result.data.size(),
+                minValue, maxValue);
+  return result;
+}
@@ -4,6 +4,13 @@ in vec3 entryPoint;
 out vec4 result;
 
 uniform sampler3D volume;
+// value*valueScale+valueOffset covers the range the data set uses, so
+// 16bit data maps to [0,1] just like its 8bit version
+uniform float valueScale;
+uniform float valueOffset;
+// one texel per macro cell, zero where the transfer function is zero
+uniform sampler3D occupancy;
+uniform vec3 macroCellSize;
 
 uniform float smoothStepStart;
 uniform float smoothStepWidth;
@@ -12,6 +19,17 @@ uniform vec3 voxelCount;
 uniform vec3 cameraPosInTextureSpace;
 uniform vec3 minBounds;
 uniform vec3 maxBounds;
+// rays stop once the accumulated opacity reaches this value
+uniform float terminationThreshold;
+// the step doubles, up to maxStepScale times, while consecutive
+// samples differ by less than adaptiveTolerance
+uniform float maxStepScale;
+uniform float adaptiveTolerance;
+// color and opacity of the segment between two samples, indexed by the
+// front and back value and built for segments of preIntegrationLength
+uniform sampler2D preIntegration;
+uniform int usePreIntegration;
+uniform float preIntegrationLength;
 
 vec4 transferFunction(float v) {
   v = clamp((v - smoothStepStart) / (smoothStepWidth), 0.0, 1.0);
@@ -39,14 +57,42 @@ void main() {
   vec3 delta = rayDirectionInTextureSpace/(samples*oversampling);
 
   vec3 currentPoint = entryPoint;
+  ivec3 lastCell = textureSize(occupancy, 0)-1;
+  float stepScale = 1.0;
+  float lastValue = -1.0;
   result = vec4(0.0);
   do {
-    // TODO: Implement raycaster and store the result in "result".
-    //       The next two lines are placeholder code ensuring all
-    //       variables are utilized. This prevents exceptions from
-    //       the initial shader. These placeholder lines should be
-    //       replaced by the raycasting code.
-    result = 1+transferFunction(texture(volume,delta).r);
-    break;
+    ivec3 cell = min(ivec3(currentPoint/macroCellSize), lastCell);
+    if (texelFetch(occupancy, cell, 0).r == 0.0) {
+      // leap to the first sample behind this empty macro cell, staying
+      // on the regular sample positions
+      vec3 exitPlane = (vec3(cell) + step(0.0, delta)) * macroCellSize;
+      vec3 stepsToExit = (exitPlane - currentPoint) / delta;
+      currentPoint += delta * max(1.0, ceil(min(stepsToExit.x, min(stepsToExit.y, stepsToExit.z))));
+      stepScale = 1.0;
+      lastValue = -1.0;
+      continue;
+    }
+
+    float value = texture(volume, currentPoint).r*valueScale + valueOffset;
+    // the first sample after a leap has no predecessor and is treated
+    // as a constant segment
+    float front = (lastValue < 0.0) ? value : lastValue;
+    float segment = stepScale;
+    stepScale = (abs(value - lastValue) < adaptiveTolerance) ? min(stepScale*2.0, maxStepScale) : 1.0;
+    lastValue = value;
+
+    vec4 current;
+    if (usePreIntegration != 0) {
+      float tableSize = float(textureSize(preIntegration, 0).x);
+      current = texture(preIntegration, (vec2(front, value)*(tableSize-1.0)+0.5)/tableSize);
+      current.a = 1.0 - pow(1.0 - current.a, opacityCorrection*segment/preIntegrationLength);
+    } else {
+      current = transferFunction(value);
+      current.a = 1.0 - pow(1.0 - current.a, opacityCorrection*stepScale);
+    }
+    result = under(current, result);
+    if (result.a >= terminationThreshold) break;
+    currentPoint += delta*stepScale;
   } while (inBounds(currentPoint));
 }
@@ -0,0 +1,156 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+
+#include <bmp.h>
+
+#include "QVis.h"
+#include "CPURaycaster.h"
+
+// renders a data set with the CPU raycaster from the initial view of
+// the GUI, no window or GPU required
+template <typename T>
+static Image render(const CPURaycaster& raycaster, const VolumeT<T>& volume,
+                    const MacroCellGrid& grid, uint32_t width, uint32_t height,
+                    double& ms) {
+  const Vec3 voxelCount{float(volume.width),float(volume.height),float(volume.depth)};
+  const Vec3 volumeExtend = volume.scale*voxelCount/float(volume.maxSize);
+  const Mat4 model = Mat4::scaling(volumeExtend);
+  const Mat4 view = Mat4::lookAt({ 0, 0, 2 }, { 0, 0, 0 }, { 0, 1, 0 });
+  const Mat4 projection = Mat4::perspective(45, float(width)/float(height), 0.1f, 100);
+
+  const auto start = std::chrono::steady_clock::now();
+  const Image image = raycaster.render(volume, width, height, projection * view * model, &grid);
+  const auto end = std::chrono::steady_clock::now();
+  ms = std::chrono::duration<double, std::milli>(end-start).count();
+  return image;
+}
+
+// frame time and image error of the acceleration options and of lower
+// sampling rates against the fixed step reference without early ray
+// termination
+template <typename T>
+static void report(const CPURaycaster& settings, const VolumeT<T>& volume,
+                   uint32_t width, uint32_t height) {
+  const MacroCellGrid grid{volume, 8, settings.valueMapping};
+
+  CPURaycaster reference = settings;
+  reference.terminationThreshold = 1.0f;
+  reference.adaptiveSampling = false;
+
+  CPURaycaster termination = reference;
+  termination.terminationThreshold = settings.terminationThreshold;
+
+  CPURaycaster adaptive = reference;
+  adaptive.adaptiveSampling = true;
+
+  CPURaycaster both = termination;
+  both.adaptiveSampling = true;
+
+  // fewer samples per ray, with and without pre-integration
+  CPURaycaster half = reference;
+  half.oversampling = reference.oversampling/2.0f;
+  CPURaycaster quarter = reference;
+  quarter.oversampling = reference.oversampling/4.0f;
+  CPURaycaster preHalf = half;
+  preHalf.preIntegration = true;
+  CPURaycaster preQuarter = quarter;
+  preQuarter.preIntegration = true;
+
+  double referenceMs;
+  const Image referenceImage = render(reference, volume, grid, width, height, referenceMs);
+
+  const std::vector<std::pair<std::string, const CPURaycaster*>> modes{
+    {"fixed step (reference)", &reference},
+    {"early termination", &termination},
+    {"adaptive steps", &adaptive},
+    {"termination + adaptive", &both},
+    {"1/2 samples", &half},
+    {"1/4 samples", &quarter},
+    {"1/2 samples pre-integr.", &preHalf},
+    {"1/4 samples pre-integr.", &preQuarter}
+  };
+
+  std::cout << std::left << std::setw(26) << "mode" << std::right
+            << std::setw(12) << "time [ms]" << std::setw(10) << "speedup"
+            << std::setw(10) << "RMSE" << std::setw(10) << "PSNR"
+            << std::setw(10) << "max err" << std::endl;
+  for (const auto& mode : modes) {
+    double ms;
+    const Image image = render(*mode.second, volume, grid, width, height, ms);
+    const CPURaycaster::ImageError error = CPURaycaster::compare(image, referenceImage);
+    std::cout << std::left << std::setw(26) << mode.first << std::right << std::fixed
+              << std::setprecision(1) << std::setw(12) << ms
+              << std::setprecision(2) << std::setw(10) << referenceMs/ms
+              << std::setw(10) << error.rmse << std::setw(10) << error.psnr
+              << std::setw(10) << int(error.maxError) << std::endl;
+  }
+}
+
+template <typename T>
+static void renderToFile(const CPURaycaster& raycaster, const VolumeT<T>& volume,
+                         uint32_t width, uint32_t height, const std::string& output) {
+  const MacroCellGrid grid{volume, 8, raycaster.valueMapping};
+  double ms;
+  const Image image = render(raycaster, volume, grid, width, height, ms);
+  std::cout << width << "x" << height << " rendered in " << ms << " ms ("
+            << double(width)*double(height)/(ms*1000.0) << " MRays/s)" << std::endl;
+  BMP::save(output, image);
+}
+
+static int usage(const char* program) {
+  std::cerr << "usage: " << program
+            << " dataset [output.bmp|--report] [width height] [oversampling]" << std::endl;
+  return EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) return usage(argv[0]);
+
+  const std::string output = (argc > 2) ? argv[2] : "raycaster.bmp";
+  uint32_t width = 512;
+  uint32_t height = 512;
+  CPURaycaster raycaster;
+
+  try {
+    if (argc > 4) {
+      const unsigned long w = std::stoul(argv[3]);
+      const unsigned long h = std::stoul(argv[4]);
+      if (w == 0 || h == 0 || w > 65536 || h > 65536) return usage(argv[0]);
+      width = uint32_t(w);
+      height = uint32_t(h);
+    }
+    if (argc > 5) {
+      raycaster.oversampling = std::stof(argv[5]);
+      if (!(raycaster.oversampling > 0.0f)) return usage(argv[0]);
+    }
+  } catch (const std::logic_error&) {
+    // std::invalid_argument or std::out_of_range from the conversions
+    return usage(argv[0]);
+  }
+
+  try {
+    const QVis qvis{argv[1], true, true};
+    if (qvis.is16Bit()) raycaster.valueMapping = computeValueMapping(qvis.volume16);
+    if (output == "--report") {
+      if (qvis.is16Bit())
+        report(raycaster, qvis.volume16, width, height);
+      else
+        report(raycaster, qvis.volume, width, height);
+    } else {
+      if (qvis.is16Bit())
+        renderToFile(raycaster, qvis.volume16, width, height, output);
+      else
+        renderToFile(raycaster, qvis.volume, width, height, output);
+    }
+  } catch (const QVisFileException& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (const BMP::BMPException& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -1,7 +1,8 @@
 #include <GLApp.h>
-#include <Tesselation.h>
 #include <ArcBall.h>
 #include "Clipper.h"
+#include "MacroCellGrid.h"
+#include "PreIntegration.h"
 
 #include "QVis.h"
 
@@ -20,41 +21,139 @@ public:
     minBounds = clipBox * Vec3{-0.5,-0.5,-0.5} + 0.5f;
     maxBounds = clipBox * Vec3{ 0.5, 0.5, 0.5} + 0.5f;
     model = Mat4::translation(0,0,zoom) * rotation * Mat4::scaling(volumeExtend);
-    modelViewProjection = projection * view * model * clipBox;
+    modelViewProjection = projection * view * model;
     viewToTexture = Mat4::translation({0.5f,0.5f,0.5f}) * Mat4::inverse(view * model);
     meshNeedsUpdte = true;
   }
 
-  void clipCubeToNearplane() {
+  // the proxy geometry is the volume cube cut by the six clip box planes
+  // and the near plane, in model space; the scratch buffers are reused
+  // and the vertex buffer, allocated once for the largest possible
+  // geometry in init, is only overwritten if the geometry changed
+  void updateProxyGeometry() {
     if (!meshNeedsUpdte) return;
     meshNeedsUpdte = false;
     // transpose( inverse( inverse(view*model) ) ) -> transpose(view*model)
     const Vec4 objectSpaceNearPlane{Mat4::transpose(view*model)*Vec4{0,0,1.0f,near+0.01f}};
-    std::vector<float> verts = Clipper::meshPlane(cube.getVertices(),
-                                                  objectSpaceNearPlane.xyz,
-                                                  objectSpaceNearPlane.w);
-    vertCount = verts.size()/3;
-    vbCube.setData(verts, 3);
+    Clipper::Plane planes[7];
+    for (size_t c = 0;c<3;++c) {
+      Vec3 normal{0,0,0};
+      normal[c] = 1.0f;
+      planes[c*2+0] = Clipper::Plane{normal*-1.0f, minBounds[c]-0.5f};
+      planes[c*2+1] = Clipper::Plane{normal, 0.5f-maxBounds[c]};
+    }
+    planes[6] = Clipper::Plane{objectSpaceNearPlane.xyz, objectSpaceNearPlane.w};
+    Clipper::meshBox(Vec3{-0.5f,-0.5f,-0.5f}, Vec3{0.5f,0.5f,0.5f}, planes, 7,
+                     clipScratch, clippedVertices);
+    if (clippedVertices == proxyVertices) return;
+    std::swap(clippedVertices, proxyVertices);
+    vertCount = proxyVertices.size()/3;
+    if (proxyVertices.size() > proxyCapacity) {
+      proxyCapacity = proxyVertices.size();
+      vbCube.setData(proxyVertices, 3, GL_DYNAMIC_DRAW);
+    } else {
+      vbCube.updateData(proxyVertices);
+    }
   }
 
   void loadVolume() {
-    volume = QVis{filenames[currentFile]}.volume;
-    voxelCount = Vec3{float(volume.width),float(volume.height),float(volume.depth)};
-    volumeExtend = volume.scale*voxelCount/float(volume.maxSize);
+    QVis qvis{filenames[currentFile], true, true};
+    qvis.buildPyramid(minLevelSize);
+    if (qvis.is16Bit())
+      uploadVolume(qvis.volume16, qvis.pyramid16);
+    else
+      uploadVolume(qvis.volume, qvis.pyramid);
+    volume = qvis.volume;
+    volume16 = qvis.volume16;
+  }
+
+  // uploads every level of the pyramid that fits into the texture
+  // budget, the finest of them is rendered when idle
+  template <typename T>
+  void uploadVolume(const VolumeT<T>& v, const std::vector<VolumeT<T>>& pyramid) {
+    volumeExtend = v.scale*Vec3{float(v.width),float(v.height),float(v.depth)}/float(v.maxSize);
+    // the range of the finest level, so all levels map values alike
+    valueMapping = computeValueMapping(v);
+
+    GLint maxTextureSize{0};
+    GL(glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTextureSize));
+
+    levels.clear();
+    for (size_t i = 0;i<=pyramid.size();++i) {
+      const VolumeT<T>& level = (i == 0) ? v : pyramid[i-1];
+      const size_t maxDim = std::max(level.width, std::max(level.height, level.depth));
+      const bool fits = level.getVoxelCount()*sizeof(T) <= textureBudget &&
+                        maxDim <= size_t(maxTextureSize);
+      if (!fits && i < pyramid.size()) continue;
 
-    volumeTex.setData(volume.data,
-                      uint32_t(volume.width),
-                      uint32_t(volume.height),
-                      uint32_t(volume.depth), 1);
+      VolumeLevel l;
+      l.voxelCount = Vec3{float(level.width),float(level.height),float(level.depth)};
+      l.texture = std::make_shared<GLTexture3D>(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE,
+                                                GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+      l.texture->setData(level.getData(),
+                         uint32_t(level.width),
+                         uint32_t(level.height),
+                         uint32_t(level.depth), 1);
+      l.grid = MacroCellGrid{level, macroCellSize, valueMapping};
+      l.macroCellSize = Vec3{float(macroCellSize),float(macroCellSize),float(macroCellSize)} / l.voxelCount;
+      l.occupancy = std::make_shared<GLTexture3D>(GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE,
+                                                  GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+      levels.push_back(l);
+    }
+    occupancyNeedsUpdate = true;
+  }
+
+  // the occupancy of the macro cells depends on the transfer function,
+  // so it is rebuilt whenever the smoothstep parameters change
+  void updateOccupancy() {
+    if (!occupancyNeedsUpdate && occupancyStepStart == stepStart &&
+        occupancyStepWidth == stepWidth) return;
+    occupancyNeedsUpdate = false;
+    occupancyStepStart = stepStart;
+    occupancyStepWidth = stepWidth;
+    for (VolumeLevel& l : levels) {
+      const std::vector<uint8_t> occupancy = l.grid.computeOccupancy(stepStart, stepWidth);
+      l.occupancy->setData(occupancy.data(),
+                           uint32_t(l.grid.cellsX),
+                           uint32_t(l.grid.cellsY),
+                           uint32_t(l.grid.cellsZ), 1);
+    }
+  }
 
+  // the table depends on the transfer function and the step length, it
+  // is built for the finest level, coarser levels correct its opacity
+  void updatePreIntegration() {
+    if (!preIntegration) return;
+    const Vec3& voxelCount = levels[0].voxelCount;
+    const float length = 100.0f/(std::max(voxelCount.x, std::max(voxelCount.y, voxelCount.z))*oversampling);
+    if (preIntegrationTable.size == preIntegrationSize &&
+        preIntegrationStepStart == stepStart && preIntegrationStepWidth == stepWidth &&
+        preIntegrationTable.segmentLength == length) return;
+    preIntegrationStepStart = stepStart;
+    preIntegrationStepWidth = stepWidth;
+    preIntegrationTable = PreIntegrationTable{
+      PreIntegrationTable::smoothStep(stepStart, stepWidth, preIntegrationSize), length};
+    preIntegrationTexture.setData(preIntegrationTable.data,
+                                  uint32_t(preIntegrationTable.size),
+                                  uint32_t(preIntegrationTable.size), 4);
+  }
+
+  // one level coarser per doubling of the sampling rate beyond 2, so
+  // the samples per ray stay about the same, and one more while the
+  // user drags the view or the transfer function
+  size_t selectLevel() const {
+    size_t level = (leftMouseDown || rightMouseDown) ? 1 : 0;
+    for (float o = oversampling;o > 2.0f;o /= 2.0f) ++level;
+    return std::min(level, levels.size()-1);
   }
 
   virtual void init() override {
     loadVolume();
 
-    vertCount = cube.getVertices().size();
+    vertCount = 0;
+    proxyCapacity = Clipper::maxBoxTriangles(7)*9;
     cubeArray.bind();
-    vbCube.setData(cube.getVertices(), 3);
+    vbCube.setData(std::vector<float>(proxyCapacity, 0.0f), 3, GL_DYNAMIC_DRAW);
     cubeArray.connectVertexAttrib(vbCube, cubeProgram, "vPos", 3);
 
     GL(glClearColor(0,0,0.5,1));
@@ -77,22 +176,35 @@ public:
   }
 
   virtual void draw() override {
-    clipCubeToNearplane();
+    updateProxyGeometry();
+    updateOccupancy();
+    updatePreIntegration();
 
     GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
+    const VolumeLevel& level = levels[selectLevel()];
+
     cubeProgram.enable();
-    cubeProgram.setTexture("volume",volumeTex,0);
+    cubeProgram.setTexture("volume",*level.texture,0);
+    cubeProgram.setTexture("occupancy",*level.occupancy,1);
+    cubeProgram.setUniform("macroCellSize", level.macroCellSize);
     cubeProgram.setUniform("modelViewProjection", modelViewProjection);
-    cubeProgram.setUniform("clip", clipBox);
     cubeProgram.setUniform("minBounds", minBounds);
     cubeProgram.setUniform("maxBounds", maxBounds);
     cubeProgram.setUniform("cameraPosInTextureSpace", (viewToTexture * Vec4{0,0,0,1}).xyz);
 
-    cubeProgram.setUniform("voxelCount", voxelCount);
+    cubeProgram.setUniform("voxelCount", level.voxelCount);
     cubeProgram.setUniform("oversampling", oversampling);
+    cubeProgram.setUniform("valueScale", valueMapping.scale);
+    cubeProgram.setUniform("valueOffset", valueMapping.offset);
     cubeProgram.setUniform("smoothStepStart", stepStart);
     cubeProgram.setUniform("smoothStepWidth", stepWidth);
+    cubeProgram.setUniform("terminationThreshold", earlyTermination ? terminationThreshold : 2.0f);
+    cubeProgram.setUniform("maxStepScale", adaptiveSampling ? maxStepScale : 1.0f);
+    cubeProgram.setUniform("adaptiveTolerance", adaptiveTolerance);
+    cubeProgram.setTexture("preIntegration", preIntegrationTexture, 2);
+    cubeProgram.setUniform("usePreIntegration", preIntegration ? 1 : 0);
+    cubeProgram.setUniform("preIntegrationLength", preIntegrationTable.segmentLength);
 
     GL(glDrawArrays(GL_TRIANGLES, 0, GLsizei(vertCount)));
   }
@@ -119,6 +231,21 @@ public:
           ss << "Raycaster (" << oversampling << " x oversampling)";
           glEnv.setTitle(ss.str());
           break;
+        case GLENV_KEY_T:
+          earlyTermination = !earlyTermination;
+          ss << "Raycaster (early ray termination " << (earlyTermination ? "on" : "off") << ")";
+          glEnv.setTitle(ss.str());
+          break;
+        case GLENV_KEY_A:
+          adaptiveSampling = !adaptiveSampling;
+          ss << "Raycaster (adaptive sampling " << (adaptiveSampling ? "on" : "off") << ")";
+          glEnv.setTitle(ss.str());
+          break;
+        case GLENV_KEY_P:
+          preIntegration = !preIntegration;
+          ss << "Raycaster (pre-integration " << (preIntegration ? "on" : "off") << ")";
+          glEnv.setTitle(ss.str());
+          break;
         case GLENV_KEY_R:
           rotation = Mat4{};
           stepStart = 0.12f;
@@ -219,16 +346,31 @@ public:
   }
 
 private:
-  Tesselation cube{Tesselation::genBrick({0, 0, 0}, {1, 1, 1}).unpack()};
+  struct VolumeLevel {
+    Vec3 voxelCount;
+    std::shared_ptr<GLTexture3D> texture;
+    MacroCellGrid grid;
+    Vec3 macroCellSize;
+    std::shared_ptr<GLTexture3D> occupancy;
+  };
+
   GLBuffer vbCube{GL_ARRAY_BUFFER};
   GLArray cubeArray;
   GLProgram cubeProgram{GLProgram::createFromFile("cubeVS.glsl", "cubeFS.glsl")};
   size_t vertCount;
   Volume volume;
-  Vec3 voxelCount;
+  Volume16 volume16;
   Vec3 volumeExtend;
-  GLTexture3D volumeTex{GL_LINEAR, GL_LINEAR,GL_CLAMP_TO_EDGE,
-    GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE};
+  // stretches 16bit data over its value range, see computeValueMapping
+  ValueMapping valueMapping;
+  // levels[0] is the finest resolution that fits into textureBudget
+  std::vector<VolumeLevel> levels;
+  size_t textureBudget{size_t(512)*1024*1024};
+  size_t minLevelSize{16};
+  size_t macroCellSize{8};
+  bool occupancyNeedsUpdate{true};
+  float occupancyStepStart{0.0f};
+  float occupancyStepWidth{0.0f};
 
   ArcBall arcball{{512, 512}};
   Mat4 rotation;
@@ -245,10 +387,25 @@ private:
   Vec3 clipBoxShift{0,0,0};
 
   float oversampling{2.0f};
+  bool earlyTermination{true};
+  float terminationThreshold{0.99f};
+  bool adaptiveSampling{false};
+  float maxStepScale{4.0f};
+  float adaptiveTolerance{0.01f};
+  bool preIntegration{false};
+  size_t preIntegrationSize{256};
+  PreIntegrationTable preIntegrationTable;
+  GLTexture2D preIntegrationTexture{GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE};
+  float preIntegrationStepStart{0.0f};
+  float preIntegrationStepWidth{0.0f};
   float near{0.1f};
   float zoom{0.0f};
 
   bool meshNeedsUpdte{true};
+  Clipper::Scratch clipScratch;
+  std::vector<float> clippedVertices;
+  std::vector<float> proxyVertices;
+  size_t proxyCapacity{0};
 
   std::vector<std::string> filenames{"c60.dat","bonsai.dat"};
   size_t currentFile{0};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "Volume.h"
+
+// optional bricked copy of a volume: the cells are split into cubic
+// bricks of brickSize^3 cells whose voxels, including their upper faces
+// and a one-voxel apron around them (clamped at the volume border), are
+// stored consecutively, so cell walks and the central differences at
+// their corners stay inside one small block of memory; every brick also
+// records the value range of its cells so consumers can skip bricks
+// that cannot contribute
+template <typename T>
+class BrickedVolumeT {
+public:
+  static const size_t apron = 1;
+
+  BrickedVolumeT() :
+    width{0}, height{0}, depth{0},
+    brickSize{0}, storedSize{0},
+    bricksX{0}, bricksY{0}, bricksZ{0}
+  {}
+
+  BrickedVolumeT(const VolumeT<T>& volume, size_t brickSize=32) :
+    width{volume.width}, height{volume.height}, depth{volume.depth},
+    brickSize{brickSize}, storedSize{brickSize+1+2*apron},
+    bricksX{bricksAlong(volume.width, brickSize)},
+    bricksY{bricksAlong(volume.height, brickSize)},
+    bricksZ{bricksAlong(volume.depth, brickSize)}
+  {
+    const size_t brickCount = getBrickCount();
+    const size_t brickVoxels = getBrickVoxelCount();
+    data.resize(brickCount*brickVoxels);
+    brickMin.resize(brickCount);
+    brickMax.resize(brickCount);
+    if (brickCount == 0) return;
+
+    const T* voxels = volume.getData();
+    const size_t sliceSize = width*height;
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t b = 0;b<int64_t(brickCount);++b) {
+      size_t ox, oy, oz;
+      getBrickOrigin(size_t(b), ox, oy, oz);
+      T* target = data.data() + size_t(b)*brickVoxels;
+      T minVal = voxels[ox + oy*width + oz*sliceSize];
+      T maxVal = minVal;
+      for (size_t z = 0;z<storedSize;++z) {
+        const size_t w = clampCoord(oz, z, depth);
+        const bool insideZ = inside(oz, z, depth);
+        for (size_t y = 0;y<storedSize;++y) {
+          const size_t v = clampCoord(oy, y, height);
+          const bool insideYZ = insideZ && inside(oy, y, height);
+          const T* row = voxels + v*width + w*sliceSize;
+          for (size_t x = 0;x<storedSize;++x) {
+            const T value = row[clampCoord(ox, x, width)];
+            if (insideYZ && inside(ox, x, width)) {
+              minVal = std::min(minVal, value);
+              maxVal = std::max(maxVal, value);
+            }
+            *target++ = value;
+          }
+        }
+      }
+      brickMin[size_t(b)] = minVal;
+      brickMax[size_t(b)] = maxVal;
+    }
+  }
+
+  size_t width;
+  size_t height;
+  size_t depth;
+
+  // edge length of a brick in cells and in stored voxels
+  size_t brickSize;
+  size_t storedSize;
+
+  size_t bricksX;
+  size_t bricksY;
+  size_t bricksZ;
+
+  std::vector<T> data;
+  std::vector<T> brickMin;
+  std::vector<T> brickMax;
+
+  size_t getBrickCount() const {
+    return bricksX*bricksY*bricksZ;
+  }
+
+  size_t getBrickVoxelCount() const {
+    return storedSize*storedSize*storedSize;
+  }
+
+  // the brick that owns voxel (x, y, z), i.e. the one in which the voxel
+  // is not on an upper face unless it lies on the upper face of the volume
+  size_t getBrickIndex(size_t x, size_t y, size_t z) const {
+    return std::min(x/brickSize, bricksX-1) +
+           std::min(y/brickSize, bricksY-1)*bricksX +
+           std::min(z/brickSize, bricksZ-1)*bricksX*bricksY;
+  }
+
+  // first voxel (in volume coordinates) covered by the brick
+  void getBrickOrigin(size_t index, size_t& x, size_t& y, size_t& z) const {
+    x = (index % bricksX) * brickSize;
+    y = ((index / bricksX) % bricksY) * brickSize;
+    z = (index / (bricksX*bricksY)) * brickSize;
+  }
+
+  const T* getBrick(size_t index) const {
+    return data.data() + index*getBrickVoxelCount();
+  }
+
+  // brick-local access, x, y and z range from -1 to brickSize+1 so the
+  // apron can be addressed without leaving the brick
+  T getBrickValue(size_t index, int64_t x, int64_t y, int64_t z) const {
+    const size_t local = size_t(x+int64_t(apron)) +
+                         size_t(y+int64_t(apron))*storedSize +
+                         size_t(z+int64_t(apron))*storedSize*storedSize;
+    return getBrick(index)[local];
+  }
+
+  T getValue(size_t u, size_t v, size_t w) const {
+    const size_t index = getBrickIndex(u, v, w);
+    size_t ox, oy, oz;
+    getBrickOrigin(index, ox, oy, oz);
+    return getBrickValue(index, int64_t(u-ox), int64_t(v-oy), int64_t(w-oz));
+  }
+
+  // central differences at the brick-local voxel (x, y, z) with x, y and
+  // z from 0 to brickSize; the clamped apron makes them one-sided at the
+  // volume border just like VolumeT::computeNormal
+  Vec3 computeNormal(size_t index, int64_t x, int64_t y, int64_t z) const {
+    const Vec3 normal{
+      float(getBrickValue(index,x-1,y,z)) - float(getBrickValue(index,x+1,y,z)),
+      float(getBrickValue(index,x,y-1,z)) - float(getBrickValue(index,x,y+1,z)),
+      float(getBrickValue(index,x,y,z-1)) - float(getBrickValue(index,x,y,z+1))
+    };
+    return Vec3::normalize(normal);
+  }
+
+  // true if an isosurface at isovalue may pass through the brick
+  bool brickContains(size_t index, T isovalue) const {
+    return brickMin[index] < isovalue && brickMax[index] >= isovalue;
+  }
+
+  // the bricks that contain cells with corners below and at or above
+  // the isovalue, in ascending order of their index
+  std::vector<uint32_t> activeBricks(T isovalue) const {
+    std::vector<uint32_t> bricks;
+    for (size_t b = 0;b<getBrickCount();++b)
+      if (brickContains(b, isovalue)) bricks.push_back(uint32_t(b));
+    return bricks;
+  }
+
+private:
+  static size_t bricksAlong(size_t voxels, size_t brickSize) {
+    return (voxels < 2) ? 0 : (voxels-1+brickSize-1)/brickSize;
+  }
+
+  static size_t clampCoord(size_t origin, size_t local, size_t size) {
+    const int64_t c = int64_t(origin) + int64_t(local) - int64_t(apron);
+    return size_t(std::min(std::max(c, int64_t(0)), int64_t(size)-1));
+  }
+
+  // true if the stored voxel belongs to the cells of the brick rather
+  // than to its apron or to a clamped copy beyond the volume border
+  bool inside(size_t origin, size_t local, size_t size) const {
+    if (local < apron) return false;
+    const size_t c = origin + local - apron;
+    return c <= origin+brickSize && c < size;
+  }
+};
+
+typedef BrickedVolumeT<uint8_t> BrickedVolume;
+typedef BrickedVolumeT<uint16_t> BrickedVolume16;
@@ -0,0 +1,144 @@
+#include <algorithm>
+
+#include "IsosurfaceCache.h"
+
+IsosurfaceCache::IsosurfaceCache(const Volume& volume, const MinMaxOctree& octree,
+                                 VertexFormat format, size_t cacheBudget,
+                                 const std::vector<int>& prefetchOffsets) :
+  volume{volume},
+  octree{octree},
+  format{format},
+  prefetchOffsets{prefetchOffsets},
+  cacheBudget{cacheBudget},
+  cacheSize{0},
+  hits{0},
+  misses{0},
+  extracting{-1},
+  stopping{false}
+{
+  prefetchThread = std::thread{&IsosurfaceCache::prefetchLoop, this};
+}
+
+IsosurfaceCache::~IsosurfaceCache() {
+  {
+    std::lock_guard<std::mutex> lock{cacheMutex};
+    stopping = true;
+    pending.clear();
+  }
+  pendingChanged.notify_all();
+  prefetchThread.join();
+}
+
+IsosurfaceCache::Surface IsosurfaceCache::get(uint8_t isovalue,
+                                              IsosurfaceAlgorithm algorithm,
+                                              bool useOctree) {
+  const uint32_t key = makeKey(isovalue, algorithm, useOctree);
+  {
+    std::unique_lock<std::mutex> lock{cacheMutex};
+    extracted.wait(lock, [this, key]() {return extracting != int64_t(key);});
+    auto entry = cache.find(key);
+    if (entry != cache.end()) {
+      lru.splice(lru.begin(), lru, entry->second.second);
+      ++hits;
+      schedulePrefetch(key);
+      return entry->second.first;
+    }
+    ++misses;
+    // no need for the prefetch thread to extract it as well
+    pending.erase(std::remove(pending.begin(), pending.end(), key), pending.end());
+  }
+
+  // extract outside the lock so the prefetch thread keeps going
+  const Surface surface = extract(key);
+
+  std::lock_guard<std::mutex> lock{cacheMutex};
+  insert(key, surface);
+  schedulePrefetch(key);
+  return surface;
+}
+
+size_t IsosurfaceCache::getCacheSize() const {
+  std::lock_guard<std::mutex> lock{cacheMutex};
+  return cacheSize;
+}
+
+size_t IsosurfaceCache::getCacheHits() const {
+  std::lock_guard<std::mutex> lock{cacheMutex};
+  return hits;
+}
+
+size_t IsosurfaceCache::getCacheMisses() const {
+  std::lock_guard<std::mutex> lock{cacheMutex};
+  return misses;
+}
+
+uint32_t IsosurfaceCache::makeKey(uint8_t isovalue, IsosurfaceAlgorithm algorithm,
+                                  bool useOctree) {
+  if (useOctree) return uint32_t(isovalue) | (1u << 9);
+  const uint32_t flyingEdges = (algorithm == IsosurfaceAlgorithm::FlyingEdges) ? 1u : 0u;
+  return uint32_t(isovalue) | (flyingEdges << 8);
+}
+
+IsosurfaceCache::Surface IsosurfaceCache::extract(uint32_t key) const {
+  const uint8_t isovalue = isovalueOf(key);
+  if (key & (1u << 9))
+    return std::make_shared<const Isosurface>(volume, octree, isovalue, true, format);
+  const IsosurfaceAlgorithm algorithm = (key & (1u << 8)) ? IsosurfaceAlgorithm::FlyingEdges
+                                                          : IsosurfaceAlgorithm::MarchingCubes;
+  return std::make_shared<const Isosurface>(volume, isovalue, true, algorithm, format);
+}
+
+size_t IsosurfaceCache::byteSize(const Isosurface& surface) {
+  return surface.vertices.size()*sizeof(Vertex) +
+         surface.interleaved.size()*sizeof(float) +
+         surface.compact.size()*sizeof(uint16_t) +
+         surface.indices.size()*sizeof(uint32_t);
+}
+
+void IsosurfaceCache::insert(uint32_t key, const Surface& surface) {
+  if (cache.find(key) != cache.end()) return;
+  const size_t bytes = byteSize(*surface);
+  while (!lru.empty() && cacheSize + bytes > cacheBudget) {
+    auto victim = cache.find(lru.back());
+    cacheSize -= byteSize(*victim->second.first);
+    cache.erase(victim);
+    lru.pop_back();
+  }
+  lru.push_front(key);
+  cache[key] = std::make_pair(surface, lru.begin());
+  cacheSize += bytes;
+}
+
+void IsosurfaceCache::schedulePrefetch(uint32_t key) {
+  // requests that were not started yet are outdated by the new one
+  pending.clear();
+  const uint32_t settings = key & ~0xFFu;
+  for (const int offset : prefetchOffsets) {
+    const int neighbor = int(isovalueOf(key)) + offset;
+    if (neighbor < 0 || neighbor > 255) continue;
+    const uint32_t neighborKey = settings | uint32_t(neighbor);
+    if (int64_t(neighborKey) == extracting) continue;
+    if (cache.find(neighborKey) == cache.end()) pending.push_back(neighborKey);
+  }
+  if (!pending.empty()) pendingChanged.notify_one();
+}
+
+void IsosurfaceCache::prefetchLoop() {
+  std::unique_lock<std::mutex> lock{cacheMutex};
+  while (true) {
+    pendingChanged.wait(lock, [this]() {return stopping || !pending.empty();});
+    if (stopping) return;
+
+    const uint32_t key = pending.front();
+    pending.pop_front();
+    if (cache.find(key) != cache.end()) continue;
+
+    extracting = int64_t(key);
+    lock.unlock();
+    const Surface surface = extract(key);
+    lock.lock();
+    extracting = -1;
+    insert(key, surface);
+    extracted.notify_all();
+  }
+}
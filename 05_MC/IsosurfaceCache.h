@@ -0,0 +1,75 @@
+#pragma once
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+#include <unordered_map>
+
+#include "MC.h"
+
+// indexed isosurfaces of one volume in an LRU cache bounded by a byte
+// budget, keyed by isovalue, algorithm and octree use; after every
+// request a background thread extracts the isovalues at prefetchOffsets
+// around it with the same settings that are not cached yet, so stepping
+// through neighboring isovalues finds them ready
+class IsosurfaceCache {
+public:
+  typedef std::shared_ptr<const Isosurface> Surface;
+
+  IsosurfaceCache(const Volume& volume, const MinMaxOctree& octree,
+                  VertexFormat format=VertexFormat::Separate,
+                  size_t cacheBudget=size_t(512)*1024*1024,
+                  const std::vector<int>& prefetchOffsets={1, -1, 5, -5});
+  ~IsosurfaceCache();
+
+  IsosurfaceCache(const IsosurfaceCache& other) = delete;
+  IsosurfaceCache& operator=(const IsosurfaceCache& other) = delete;
+
+  // thread safe, the returned surface stays valid even if it is evicted;
+  // waits if the background thread is extracting this surface already;
+  // with the octree the algorithm is always marching cubes
+  Surface get(uint8_t isovalue,
+              IsosurfaceAlgorithm algorithm=IsosurfaceAlgorithm::MarchingCubes,
+              bool useOctree=true);
+
+  size_t getCacheSize() const;
+  size_t getCacheHits() const;
+  size_t getCacheMisses() const;
+
+private:
+  const Volume& volume;
+  const MinMaxOctree& octree;
+  VertexFormat format;
+  std::vector<int> prefetchOffsets;
+
+  size_t cacheBudget;
+  size_t cacheSize;
+  size_t hits;
+  size_t misses;
+  std::list<uint32_t> lru;
+  std::unordered_map<uint32_t, std::pair<Surface, std::list<uint32_t>::iterator>> cache;
+  mutable std::mutex cacheMutex;
+
+  // keys the background thread is yet to extract, nearest first, and the
+  // one it is working on, -1 if none
+  std::deque<uint32_t> pending;
+  int64_t extracting;
+  bool stopping;
+  std::condition_variable pendingChanged;
+  std::condition_variable extracted;
+  std::thread prefetchThread;
+
+  // the isovalue in the low byte, the settings above it
+  static uint32_t makeKey(uint8_t isovalue, IsosurfaceAlgorithm algorithm, bool useOctree);
+  static uint8_t isovalueOf(uint32_t key) {return uint8_t(key & 0xFF);}
+
+  Surface extract(uint32_t key) const;
+  static size_t byteSize(const Isosurface& surface);
+  // the following expect cacheMutex to be locked
+  void insert(uint32_t key, const Surface& surface);
+  void schedulePrefetch(uint32_t key);
+  void prefetchLoop();
+};
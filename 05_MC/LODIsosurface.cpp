@@ -0,0 +1,577 @@
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+#include "LODIsosurface.h"
+#include "MC.inl"
+
+static const uint32_t noVertex = 0xFFFFFFFFu;
+static const uint32_t noSignature = 0xFFFFFFFFu;
+
+typedef std::array<size_t,3> GridPoint;
+
+// the grid of one block at one level along one axis: grid point i is
+// voxel min(start + i*2^level, end), so the grids of all levels share
+// the block's first and last voxel and every other point of a grid is a
+// point of the next coarser one
+struct BlockAxis {
+  size_t start, end, step, count;
+
+  BlockAxis(size_t block, size_t blockSize, size_t voxels, size_t level) :
+    start{block*blockSize},
+    end{std::min(start+blockSize, voxels-1)},
+    step{size_t(1) << level},
+    count{(end-start+step-1)/step}
+  {}
+
+  size_t position(size_t i) const {return std::min(start + i*step, end);}
+  bool coarse(size_t i) const {return i % 2 == 0 || i == count;}
+  bool boundary(size_t i) const {return i == 0 || i == count;}
+};
+
+static std::array<GridPoint,8> computeCellCorners() {
+  std::array<GridPoint,8> corners;
+  for (size_t c = 0;c<8;++c)
+    corners[c] = GridPoint{size_t(vertexPosTable[c].x), size_t(vertexPosTable[c].y),
+                           size_t(vertexPosTable[c].z)};
+  return corners;
+}
+
+static const std::array<GridPoint,8> cellCorners = computeCellCorners();
+
+// a cell edge as its lower and upper corner and the axis it runs along
+struct CellEdge {
+  uint8_t lower, upper;
+  size_t axis;
+};
+
+static std::array<CellEdge,12> computeCellEdges() {
+  std::array<CellEdge,12> edges;
+  for (size_t e = 0;e<12;++e) {
+    uint8_t a = edgeToVertexTable[e][0];
+    uint8_t b = edgeToVertexTable[e][1];
+    size_t axis = 0;
+    while (cellCorners[a][axis] == cellCorners[b][axis]) ++axis;
+    if (cellCorners[a][axis] > cellCorners[b][axis]) std::swap(a, b);
+    edges[e] = CellEdge{a, b, axis};
+  }
+  return edges;
+}
+
+static const std::array<CellEdge,12> cellEdges = computeCellEdges();
+
+static float voxelValue(const Volume& volume, const GridPoint& p) {
+  return float(volume.getData()[p[0] + p[1]*volume.width + p[2]*volume.width*volume.height]);
+}
+
+// the vertex where the isosurface cuts the grid edge from voxel a to the
+// voxel b above it, which have the values va and vb; both blocks that
+// share the edge compute it from the same voxels, so they agree exactly
+static Vertex gridVertex(const Volume& volume, const GridPoint& a, const GridPoint& b,
+                         float va, float vb, float iso, const Vec3& origin,
+                         const Vec3& voxelSize) {
+  const float t = (va != vb) ? (iso-va)/(vb-va) : 0.5f;
+  const Vec3 pa{float(a[0]), float(a[1]), float(a[2])};
+  const Vec3 pb{float(b[0]), float(b[1]), float(b[2])};
+  const Vec3 na = volume.getNormal(a[0], a[1], a[2]);
+  const Vec3 nb = volume.getNormal(b[0], b[1], b[2]);
+  return Vertex{origin + (pa + (pb-pa)*t)*voxelSize, Vec3::normalize(na + (nb-na)*t)};
+}
+
+// whether the face of a cell normal to normalAxis, the lower one for
+// face 0, has two diagonal corners below the isovalue
+static bool ambiguousFace(uint8_t cubeIndex, size_t normalAxis, size_t face) {
+  std::vector<uint8_t> below;
+  for (uint8_t c = 0;c<8;++c)
+    if (cellCorners[c][normalAxis] == face && (cubeIndex & (1 << c))) below.push_back(c);
+  if (below.size() != 2) return false;
+  size_t differing = 0;
+  for (size_t a = 0;a<3;++a)
+    if (cellCorners[below[0]][a] != cellCorners[below[1]][a]) ++differing;
+  return differing == 2;
+}
+
+static bool onFace(uint8_t e, size_t normalAxis, size_t face) {
+  return cellCorners[cellEdges[e].lower][normalAxis] == face &&
+         cellCorners[cellEdges[e].upper][normalAxis] == face;
+}
+
+// the corner two edges of a cell share
+static uint8_t sharedCorner(uint8_t ea, uint8_t eb) {
+  const CellEdge& a = cellEdges[ea];
+  const CellEdge& b = cellEdges[eb];
+  return (a.lower == b.lower || a.lower == b.upper) ? a.lower : a.upper;
+}
+
+// whether the triangles tris of a cell cut the corners below the
+// isovalue off that face rather than the ones above
+static bool cutsOffBelow(const std::array<uint8_t,16>& tris, uint8_t cubeIndex,
+                         size_t normalAxis, size_t face) {
+  for (uint8_t i = 0;tris[i] != N_E;i += 3) {
+    for (uint8_t j = 0;j<3;++j) {
+      const uint8_t ea = tris[i+j];
+      const uint8_t eb = tris[i+(j+1)%3];
+      if (onFace(ea, normalAxis, face) && onFace(eb, normalAxis, face))
+        return (cubeIndex & (1 << sharedCorner(ea, eb))) != 0;
+    }
+  }
+  return false;
+}
+
+// a segment of the isosurface on a cell face and the voxel of the face
+// corner it cuts off
+struct FaceSegment {
+  Vec3 a, b;
+  GridPoint corner;
+};
+
+// the part of the isosurface a coarse cell has on one of its faces
+struct FaceContour {
+  std::vector<FaceSegment> segments;
+  // whether the face has two diagonal corners below the isovalue and, if
+  // so, whether the segments cut those off rather than the other two
+  bool ambiguous;
+  bool separatesBelow;
+};
+
+// the contour marching cubes produces on the face normal to normalAxis of
+// the cell spanning the voxels lower to upper, the lower or the upper face
+static FaceContour faceContour(const Volume& volume, const GridPoint& lower,
+                               const GridPoint& upper, size_t normalAxis,
+                               bool lowerFace, float iso, const Vec3& origin,
+                               const Vec3& voxelSize) {
+  std::array<GridPoint,8> corners;
+  std::array<float,8> values;
+  uint8_t cubeIndex = 0;
+  for (uint8_t c = 0;c<8;++c) {
+    for (size_t a = 0;a<3;++a) corners[c][a] = cellCorners[c][a] ? upper[a] : lower[a];
+    values[c] = voxelValue(volume, corners[c]);
+    if (values[c] < iso) cubeIndex |= uint8_t(1 << c);
+  }
+
+  const size_t face = lowerFace ? 0 : 1;
+  const auto edgePosition = [&](uint8_t e) {
+    const CellEdge& edge = cellEdges[e];
+    return gridVertex(volume, corners[edge.lower], corners[edge.upper],
+                      values[edge.lower], values[edge.upper], iso, origin, voxelSize).position;
+  };
+
+  const std::array<uint8_t,16>& tris = trisTable[cubeIndex];
+  FaceContour contour{{}, ambiguousFace(cubeIndex, normalAxis, face),
+                      cutsOffBelow(tris, cubeIndex, normalAxis, face)};
+  for (uint8_t i = 0;tris[i] != N_E;i += 3) {
+    for (uint8_t j = 0;j<3;++j) {
+      const uint8_t ea = tris[i+j];
+      const uint8_t eb = tris[i+(j+1)%3];
+      if (onFace(ea, normalAxis, face) && onFace(eb, normalAxis, face))
+        contour.segments.push_back(FaceSegment{edgePosition(ea), edgePosition(eb),
+                                               corners[sharedCorner(ea, eb)]});
+    }
+  }
+  return contour;
+}
+
+// the point closest to p on the segments that cut off corner, or on any
+// of them if corner is nullptr
+static Vec3 closestPoint(const std::vector<FaceSegment>& segments, const GridPoint* corner,
+                         const Vec3& p) {
+  Vec3 result = p;
+  float best = -1.0f;
+  for (const FaceSegment& segment : segments) {
+    if (corner && segment.corner != *corner) continue;
+    const Vec3 d = segment.b - segment.a;
+    const float length = Vec3::dot(d, d);
+    const float t = (length > 0.0f)
+                      ? std::min(std::max(Vec3::dot(p - segment.a, d)/length, 0.0f), 1.0f)
+                      : 0.0f;
+    const Vec3 q = segment.a + d*t;
+    const float distance = (q-p).sqlength();
+    if (best < 0.0f || distance < best) {
+      best = distance;
+      result = q;
+    }
+  }
+  return result;
+}
+
+static size_t blocksAlong(size_t voxels, size_t blockSize) {
+  return (voxels < 2) ? 0 : (voxels-1+blockSize-1)/blockSize;
+}
+
+LODIsosurface::LODIsosurface(const Volume& volume, uint8_t isovalue, VertexFormat format,
+                             size_t blockSize, size_t levelCount) :
+  volume{volume},
+  isovalue{isovalue},
+  blockSize{blockSize},
+  levelCount{std::max<size_t>(levelCount, 1)},
+  blocksX{blocksAlong(volume.width, blockSize)},
+  blocksY{blocksAlong(volume.height, blockSize)},
+  blocksZ{blocksAlong(volume.depth, blockSize)},
+  levels(getBlockCount(), 0),
+  signatures(getBlockCount(), noSignature),
+  meshes(getBlockCount()),
+  surface{true, format},
+  updatedBlocks{0}
+{
+  const Vec3 voxelCount{float(volume.width), float(volume.height), float(volume.depth)};
+  const Vec3 extent = volume.scale*voxelCount/float(volume.maxSize);
+  voxelSize = extent/voxelCount;
+  origin = voxelSize*0.5f - extent*0.5f;
+  surface.setBounds(volume, volume.depth);
+}
+
+void LODIsosurface::setIsovalue(uint8_t isovalue) {
+  if (isovalue == this->isovalue) return;
+  this->isovalue = isovalue;
+  signatures.assign(getBlockCount(), noSignature);
+}
+
+int LODIsosurface::levelAt(const std::vector<uint8_t>& levels,
+                           int64_t x, int64_t y, int64_t z) const {
+  if (x < 0 || y < 0 || z < 0 ||
+      x >= int64_t(blocksX) || y >= int64_t(blocksY) || z >= int64_t(blocksZ)) return -1;
+  return levels[size_t(x) + size_t(y)*blocksX + size_t(z)*blocksX*blocksY];
+}
+
+std::vector<uint8_t> LODIsosurface::selectLevels(const Vec3& camera) const {
+  std::vector<uint8_t> result(getBlockCount());
+  for (size_t bz = 0;bz<blocksZ;++bz) {
+    for (size_t by = 0;by<blocksY;++by) {
+      for (size_t bx = 0;bx<blocksX;++bx) {
+        const BlockAxis x{bx, blockSize, volume.width, 0};
+        const BlockAxis y{by, blockSize, volume.height, 0};
+        const BlockAxis z{bz, blockSize, volume.depth, 0};
+        const Vec3 lower = origin + Vec3{float(x.start), float(y.start), float(z.start)}*voxelSize;
+        const Vec3 upper = origin + Vec3{float(x.end), float(y.end), float(z.end)}*voxelSize;
+        const Vec3 outside = Vec3::maxV(Vec3::maxV(lower-camera, camera-upper), Vec3{0.0f, 0.0f, 0.0f});
+        const float distance = outside.length();
+
+        size_t level = 0;
+        float reach = detailDistance;
+        while (level+1 < levelCount && distance > reach) {
+          ++level;
+          reach *= 2.0f;
+        }
+        // every block keeps at least two cells along each axis
+        while (level > 0 && (BlockAxis{bx, blockSize, volume.width, level}.count < 2 ||
+                             BlockAxis{by, blockSize, volume.height, level}.count < 2 ||
+                             BlockAxis{bz, blockSize, volume.depth, level}.count < 2))
+          --level;
+        result[bx + by*blocksX + bz*blocksX*blocksY] = uint8_t(level);
+      }
+    }
+  }
+
+  // blocks that touch, also only along an edge or in a corner, differ by
+  // at most one level
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t b = 0;b<result.size();++b) {
+      const int64_t x = int64_t(b % blocksX);
+      const int64_t y = int64_t((b / blocksX) % blocksY);
+      const int64_t z = int64_t(b / (blocksX*blocksY));
+      for (int64_t dz = -1;dz<=1;++dz) {
+        for (int64_t dy = -1;dy<=1;++dy) {
+          for (int64_t dx = -1;dx<=1;++dx) {
+            const int neighbor = levelAt(result, x+dx, y+dy, z+dz);
+            if (neighbor >= 0 && int(result[b]) > neighbor+1) {
+              result[b] = uint8_t(neighbor+1);
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+  }
+  return result;
+}
+
+// the level of the block and which of its 26 neighbors are coarser, all
+// that its mesh depends on
+uint32_t LODIsosurface::signature(const std::vector<uint8_t>& levels, size_t block) const {
+  const int64_t x = int64_t(block % blocksX);
+  const int64_t y = int64_t((block / blocksX) % blocksY);
+  const int64_t z = int64_t(block / (blocksX*blocksY));
+  const int level = levels[block];
+  uint32_t result = uint32_t(level);
+  uint32_t bit = 8;
+  for (int64_t dz = -1;dz<=1;++dz) {
+    for (int64_t dy = -1;dy<=1;++dy) {
+      for (int64_t dx = -1;dx<=1;++dx) {
+        if (levelAt(levels, x+dx, y+dy, z+dz) > level) result |= bit;
+        bit <<= 1;
+      }
+    }
+  }
+  return result;
+}
+
+bool LODIsosurface::update(const Vec3& camera) {
+  const std::vector<uint8_t> selected = selectLevels(camera);
+  std::vector<uint32_t> newSignatures(getBlockCount());
+  std::vector<size_t> changed;
+  for (size_t b = 0;b<getBlockCount();++b) {
+    newSignatures[b] = signature(selected, b);
+    if (newSignatures[b] != signatures[b]) changed.push_back(b);
+  }
+  levels = selected;
+  signatures = newSignatures;
+  updatedBlocks = changed.size();
+  if (changed.empty()) return false;
+
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t i = 0;i<int64_t(changed.size());++i)
+    meshes[changed[size_t(i)]] = extractBlock(levels, changed[size_t(i)]);
+  assemble();
+  return true;
+}
+
+LODIsosurface::BlockMesh LODIsosurface::extractBlock(const std::vector<uint8_t>& levels,
+                                                     size_t block) const {
+  const size_t bx = block % blocksX;
+  const size_t by = (block / blocksX) % blocksY;
+  const size_t bz = block / (blocksX*blocksY);
+  const size_t level = levels[block];
+  const std::array<size_t,3> blockIndex{bx, by, bz};
+  const std::array<size_t,3> voxels{volume.width, volume.height, volume.depth};
+  const std::array<BlockAxis,3> axes{BlockAxis{bx, blockSize, volume.width, level},
+                                     BlockAxis{by, blockSize, volume.height, level},
+                                     BlockAxis{bz, blockSize, volume.depth, level}};
+  const float iso = float(isovalue);
+  const size_t rowSize = axes[0].count+1;
+  const size_t sliceSize = rowSize*(axes[1].count+1);
+  const auto index = [rowSize, sliceSize](const GridPoint& p) {
+    return p[0] + p[1]*rowSize + p[2]*sliceSize;
+  };
+  const auto voxel = [&axes](const GridPoint& p) {
+    return GridPoint{axes[0].position(p[0]), axes[1].position(p[1]), axes[2].position(p[2])};
+  };
+  const auto rawValue = [this, &voxel](const GridPoint& p) {
+    return voxelValue(volume, voxel(p));
+  };
+
+  // the coarsest level of the blocks that contain grid point p, without
+  // looking across the block boundary along axis skip
+  const auto sharedLevel = [&](const GridPoint& p, size_t skip) {
+    int result = int(level);
+    for (int64_t dz = -1;dz<=1;++dz) {
+      for (int64_t dy = -1;dy<=1;++dy) {
+        for (int64_t dx = -1;dx<=1;++dx) {
+          const std::array<int64_t,3> d{dx, dy, dz};
+          bool contained = true;
+          for (size_t a = 0;a<3;++a)
+            if (d[a] != 0 && (a == skip || p[a] != (d[a] < 0 ? 0 : axes[a].count)))
+              contained = false;
+          if (contained)
+            result = std::max(result, levelAt(levels, int64_t(bx)+dx, int64_t(by)+dy, int64_t(bz)+dz));
+        }
+      }
+    }
+    return result;
+  };
+
+  // the contour of the coarser neighbor across the face normal to axis
+  // normalAxis on the coarse cell of that face from grid point lo to hi
+  const auto neighborContour = [&](GridPoint lo, GridPoint hi, size_t normalAxis) {
+    const bool above = lo[normalAxis] != 0;
+    const BlockAxis neighbor{above ? blockIndex[normalAxis]+1 : blockIndex[normalAxis]-1,
+                             blockSize, voxels[normalAxis], level+1};
+    GridPoint lower = voxel(lo), upper = voxel(hi);
+    if (above)
+      upper[normalAxis] = neighbor.position(1);
+    else
+      lower[normalAxis] = neighbor.position(neighbor.count-1);
+    return faceContour(volume, lower, upper, normalAxis, above, iso, origin, voxelSize);
+  };
+
+  std::vector<float> values(sliceSize*(axes[2].count+1));
+  for (size_t k = 0;k<=axes[2].count;++k)
+    for (size_t j = 0;j<=axes[1].count;++j)
+      for (size_t i = 0;i<=axes[0].count;++i)
+        values[index({i,j,k})] = rawValue({i,j,k});
+
+  // samples on faces and edges shared with a coarser block take the values
+  // the coarse grid interpolates there, so both blocks see the same contour;
+  // in the center of an ambiguous coarse face the sample is moved to the
+  // side that gives the fine cells the coarse cell's topology
+  for (size_t k = 0;k<=axes[2].count;++k) {
+    for (size_t j = 0;j<=axes[1].count;++j) {
+      for (size_t i = 0;i<=axes[0].count;++i) {
+        const GridPoint p{i, j, k};
+        if (!axes[0].boundary(i) && !axes[1].boundary(j) && !axes[2].boundary(k)) continue;
+        if (sharedLevel(p, 3) <= int(level)) continue;
+
+        GridPoint lo = p, hi = p;
+        std::vector<size_t> between;
+        size_t normalAxis = 0;
+        for (size_t a = 0;a<3;++a) {
+          if (axes[a].boundary(p[a])) {
+            normalAxis = a;
+          } else if (!axes[a].coarse(p[a])) {
+            lo[a] = p[a]-1;
+            hi[a] = p[a]+1;
+            between.push_back(a);
+          }
+        }
+        if (between.empty()) continue;
+
+        float value = 0.0f;
+        for (size_t c = 0;c < (size_t(1) << between.size());++c) {
+          GridPoint q = p;
+          float weight = 1.0f;
+          for (size_t n = 0;n<between.size();++n) {
+            const BlockAxis& axis = axes[between[n]];
+            const float t = float(axis.position(p[between[n]]) - axis.position(lo[between[n]])) /
+                            float(axis.position(hi[between[n]]) - axis.position(lo[between[n]]));
+            const bool upper = (c >> n) & 1;
+            q[between[n]] = upper ? hi[between[n]] : lo[between[n]];
+            weight *= upper ? t : 1.0f-t;
+          }
+          value += weight*rawValue(q);
+        }
+        if (between.size() == 2) {
+          const FaceContour contour = neighborContour(lo, hi, normalAxis);
+          if (contour.ambiguous)
+            value = contour.separatesBelow ? std::max(value, iso+0.5f) : std::min(value, iso-0.5f);
+        }
+        values[index(p)] = value;
+      }
+    }
+  }
+
+  BlockMesh mesh;
+  // the grid edge of every vertex, by its lower point and axis
+  std::vector<std::pair<GridPoint,size_t>> vertexEdges;
+  std::vector<uint32_t> edgeCache(3*values.size(), noVertex);
+  for (size_t k = 0;k<axes[2].count;++k) {
+    for (size_t j = 0;j<axes[1].count;++j) {
+      for (size_t i = 0;i<axes[0].count;++i) {
+        std::array<float,8> corners;
+        uint8_t cubeIndex = 0;
+        for (uint8_t c = 0;c<8;++c) {
+          corners[c] = values[index({i+cellCorners[c][0], j+cellCorners[c][1], k+cellCorners[c][2]})];
+          if (corners[c] < iso) cubeIndex |= uint8_t(1 << c);
+        }
+        if (edgeTable[cubeIndex] == 0) continue;
+
+        std::array<uint32_t,12> edgeIndices;
+        for (uint8_t e = 0;e<12;++e) {
+          if (!(edgeTable[cubeIndex] & (1 << e))) continue;
+          const CellEdge& edge = cellEdges[e];
+          const GridPoint lower{i+cellCorners[edge.lower][0], j+cellCorners[edge.lower][1],
+                                k+cellCorners[edge.lower][2]};
+          uint32_t& cached = edgeCache[index(lower)*3 + edge.axis];
+          if (cached == noVertex) {
+            GridPoint upper = lower;
+            ++upper[edge.axis];
+            cached = uint32_t(mesh.vertices.size());
+            mesh.vertices.push_back(gridVertex(volume, voxel(lower), voxel(upper),
+                                               corners[edge.lower], corners[edge.upper],
+                                               iso, origin, voxelSize));
+            vertexEdges.push_back(std::make_pair(lower, edge.axis));
+          }
+          edgeIndices[e] = cached;
+        }
+        // flipped like in Isosurface to wind counter clockwise around the normal
+        const std::array<uint8_t,16>& tris = trisTable[cubeIndex];
+        for (uint8_t t = 0;tris[t] != N_E;t += 3) {
+          mesh.indices.push_back(edgeIndices[tris[t]]);
+          mesh.indices.push_back(edgeIndices[tris[t+2]]);
+          mesh.indices.push_back(edgeIndices[tris[t+1]]);
+        }
+      }
+    }
+  }
+
+  // vertices on edges of the coarse grid become the coarse block's
+  // vertices, the others on a face shared with a coarser block move onto
+  // its contour; together with the samples above the fine mesh then
+  // follows the coarse one along the face, with T-junctions but no gaps;
+  // the vertex is at grid point p or, for running < 3, on the edge from p
+  // along that axis
+  const auto snap = [&](Vertex& vertex, const GridPoint& p, size_t running) {
+    if (sharedLevel(p, running) <= int(level)) return;
+    GridPoint lo = p, hi = p;
+    std::vector<size_t> between;
+    size_t normalAxis = 0;
+    for (size_t a = 0;a<3;++a) {
+      if (a == running) {
+        lo[a] = p[a] - p[a] % 2;
+        hi[a] = std::min(lo[a]+2, axes[a].count);
+        between.push_back(a);
+      } else if (axes[a].boundary(p[a])) {
+        normalAxis = a;
+      } else if (!axes[a].coarse(p[a])) {
+        lo[a] = p[a]-1;
+        hi[a] = p[a]+1;
+        between.push_back(a);
+      }
+    }
+    if (between.size() == 1) {
+      vertex = gridVertex(volume, voxel(lo), voxel(hi), rawValue(lo), rawValue(hi),
+                          iso, origin, voxelSize);
+      return;
+    }
+    if (between.size() != 2) return;
+
+    // on an ambiguous face the vertex belongs to the segment around the
+    // coarse corner that its edge's end on the cut off side connects to
+    const FaceContour contour = neighborContour(lo, hi, normalAxis);
+    if (!contour.ambiguous || running == 3) {
+      vertex.position = closestPoint(contour.segments, nullptr, vertex.position);
+      return;
+    }
+    const auto cutOff = [&](const GridPoint& q) {
+      return contour.separatesBelow == (values[index(q)] < iso);
+    };
+    GridPoint end = p;
+    ++end[running];
+    if (!cutOff(end)) end = p;
+    GridPoint corner = end;
+    for (size_t a = 0;a<3;++a) {
+      if (a == normalAxis || axes[a].coarse(end[a])) continue;
+      GridPoint candidate = end;
+      candidate[a] = end[a]-1;
+      corner[a] = cutOff(candidate) ? end[a]-1 : end[a]+1;
+    }
+    const GridPoint cornerVoxel = voxel(corner);
+    vertex.position = closestPoint(contour.segments, &cornerVoxel, vertex.position);
+  };
+  for (size_t v = 0;v<mesh.vertices.size();++v) {
+    const GridPoint& p = vertexEdges[v].first;
+    const size_t axis = vertexEdges[v].second;
+    GridPoint upper = p;
+    ++upper[axis];
+    // a vertex right on a sample belongs to all edges through it
+    if (values[index(p)] == iso)
+      snap(mesh.vertices[v], p, 3);
+    else if (values[index(upper)] == iso)
+      snap(mesh.vertices[v], upper, 3);
+    else
+      snap(mesh.vertices[v], p, axis);
+  }
+  return mesh;
+}
+
+void LODIsosurface::assemble() {
+  const size_t blockCount = getBlockCount();
+  std::vector<size_t> vertexOffsets(blockCount+1, 0);
+  std::vector<size_t> indexOffsets(blockCount+1, 0);
+  for (size_t b = 0;b<blockCount;++b) {
+    vertexOffsets[b+1] = vertexOffsets[b] + meshes[b].vertices.size();
+    indexOffsets[b+1] = indexOffsets[b] + meshes[b].indices.size();
+  }
+  surface.resizeVertices(vertexOffsets[blockCount]);
+  surface.indices.resize(indexOffsets[blockCount]);
+
+#pragma omp parallel for
+  for (int64_t b = 0;b<int64_t(blockCount);++b) {
+    const BlockMesh& mesh = meshes[size_t(b)];
+    for (size_t j = 0;j<mesh.vertices.size();++j)
+      surface.setVertex(vertexOffsets[size_t(b)] + j, mesh.vertices[j]);
+    uint32_t* target = surface.indices.data() + indexOffsets[size_t(b)];
+    const uint32_t offset = uint32_t(vertexOffsets[size_t(b)]);
+    for (size_t j = 0;j<mesh.indices.size();++j) target[j] = mesh.indices[j] + offset;
+  }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include "MC.h"
+
+// view dependent level of detail isosurface of one volume: the volume is
+// split into blocks of blockSize cells, each extracted on a grid that
+// takes every 2^level-th voxel, one level coarser for every doubling of
+// its distance to the camera beyond detailDistance; neighboring blocks
+// differ by at most one level, and where a block meets a coarser one its
+// boundary samples are interpolated from the coarse grid and its boundary
+// vertices are snapped onto the coarse block's contour, so the levels fit
+// without cracks; only blocks whose level or neighborhood changed are
+// extracted again when the camera moves
+class LODIsosurface {
+public:
+  LODIsosurface(const Volume& volume, uint8_t isovalue,
+                VertexFormat format=VertexFormat::Separate,
+                size_t blockSize=32, size_t levelCount=4);
+
+  // in the units of the surface positions, the volume spans at most 1
+  float detailDistance{0.5f};
+
+  void setIsovalue(uint8_t isovalue);
+  uint8_t getIsovalue() const {return isovalue;}
+
+  // selects the levels for a camera at position camera, given in the
+  // coordinates of the surface, and extracts the blocks that changed;
+  // returns whether the surface changed
+  bool update(const Vec3& camera);
+
+  // indexed, vertices on the seams between blocks are stored twice
+  const Isosurface& getSurface() const {return surface;}
+
+  size_t getBlockCount() const {return blocksX*blocksY*blocksZ;}
+  size_t getLevel(size_t block) const {return levels[block];}
+  // blocks extracted by the last update
+  size_t getUpdatedBlocks() const {return updatedBlocks;}
+
+private:
+  struct BlockMesh {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+  };
+
+  const Volume& volume;
+  uint8_t isovalue;
+  size_t blockSize;
+  size_t levelCount;
+  size_t blocksX;
+  size_t blocksY;
+  size_t blocksZ;
+  Vec3 origin;
+  Vec3 voxelSize;
+
+  std::vector<uint8_t> levels;
+  // the level and coarser neighbors each block mesh was extracted for
+  std::vector<uint32_t> signatures;
+  std::vector<BlockMesh> meshes;
+  Isosurface surface;
+  size_t updatedBlocks;
+
+  std::vector<uint8_t> selectLevels(const Vec3& camera) const;
+  int levelAt(const std::vector<uint8_t>& levels, int64_t x, int64_t y, int64_t z) const;
+  uint32_t signature(const std::vector<uint8_t>& levels, size_t block) const;
+  BlockMesh extractBlock(const std::vector<uint8_t>& levels, size_t block) const;
+  void assemble();
+};
@@ -1,7 +1,1209 @@
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
 #include "MC.h"
 #include "MC.inl"
 
-Isosurface::Isosurface(const Volume& volume, uint8_t isovalue) {
-  // TODO: compute isosurface using the mc-algorithm and store
-  //       the mesh in the vertices vector
+// cell layers per work item of extract, small enough that even a 256^3
+// volume keeps many cores busy, large enough to amortize the buffers
+static const size_t slabDepth = 2;
+
+// marks an index that refers to an edge of the next work item
+static const uint32_t deferredFlag = 0x80000000u;
+static const uint32_t noVertex = 0xFFFFFFFFu;
+
+// a cell edge as the axis it runs along and the offset of its first
+// corner within the cell
+struct CellEdge {
+  size_t axis;
+  size_t dx, dy, dz;
+};
+
+static std::array<CellEdge,12> computeCellEdges() {
+  std::array<CellEdge,12> edges;
+  for (size_t e = 0;e<12;++e) {
+    const Vec3& a = vertexPosTable[edgeToVertexTable[e][0]];
+    const Vec3& b = vertexPosTable[edgeToVertexTable[e][1]];
+    edges[e].axis = (a.x != b.x) ? 0 : ((a.y != b.y) ? 1 : 2);
+    edges[e].dx = size_t(std::min(a.x, b.x));
+    edges[e].dy = size_t(std::min(a.y, b.y));
+    edges[e].dz = size_t(std::min(a.z, b.z));
+  }
+  return edges;
+}
+
+static const std::array<CellEdge,12> cellEdges = computeCellEdges();
+
+// the output of one work item of extract
+struct SlabMesh {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  // (key, vertex) of the x and y edges in the first slice, sorted by key;
+  // the work item below resolves its deferred indices through it
+  std::vector<std::pair<uint32_t,uint32_t>> firstSliceEdges;
+  // positions in indices that hold deferredFlag and the key of an edge in
+  // the last slice, which belongs to the next work item
+  std::vector<size_t> deferred;
+};
+
+Isosurface::Isosurface(const Volume& volume, uint8_t isovalue, bool indexed,
+                       IsosurfaceAlgorithm algorithm, VertexFormat format) :
+  indexed{indexed},
+  algorithm{algorithm},
+  format{format}
+{
+  setBounds(volume, volume.depth);
+  if (volume.depth < 2) return;
+  if (algorithm == IsosurfaceAlgorithm::FlyingEdges)
+    extractFlyingEdges(volume, 0, volume.depth, 0, volume.depth-1, isovalue);
+  else
+    extract(volume, 0, volume.depth, 0, volume.depth-1, isovalue);
+}
+
+Isosurface::Isosurface(StreamingVolume& volume, uint8_t isovalue, bool indexed,
+                       IsosurfaceAlgorithm algorithm, VertexFormat format) :
+  indexed{indexed},
+  algorithm{algorithm},
+  format{format}
+{
+  // every slab holds one brick layer, the slice behind it for the cells
+  // between two layers and one more slice on either side, so all
+  // gradients are central differences like in the whole volume
+  const size_t depth = volume.getLayout().depth;
+  setBounds(volume.getLayout(), depth);
+  volume.forEachSlab(1, 2, [this, depth, isovalue](const Volume& slab, size_t zFirst,
+                                                   size_t zStart, size_t zEnd) {
+    size_t cellBegin, cellEnd;
+    if (!slabCells(zFirst, zStart, zEnd, depth, cellBegin, cellEnd)) return;
+    if (this->algorithm == IsosurfaceAlgorithm::FlyingEdges)
+      extractFlyingEdges(slab, zFirst, depth, cellBegin, cellEnd, isovalue);
+    else
+      extract(slab, zFirst, depth, cellBegin, cellEnd, isovalue);
+  });
+}
+
+Isosurface::Isosurface(const Volume& volume, const MinMaxOctree& octree,
+                       uint8_t isovalue, bool indexed, VertexFormat format) :
+  indexed{indexed},
+  algorithm{IsosurfaceAlgorithm::MarchingCubes},
+  format{format}
+{
+  setBounds(volume, volume.depth);
+  extractBricks(volume, octree, isovalue);
+}
+
+Isosurface::Isosurface(const Volume& volume, const BrickedVolume& bricks,
+                       uint8_t isovalue, bool indexed, VertexFormat format) :
+  indexed{indexed},
+  algorithm{IsosurfaceAlgorithm::MarchingCubes},
+  format{format}
+{
+  setBounds(volume, volume.depth);
+  extractBricks(volume, bricks, isovalue);
+}
+
+Isosurface::Isosurface(bool indexed, VertexFormat format) :
+  indexed{indexed},
+  algorithm{IsosurfaceAlgorithm::MarchingCubes},
+  format{format}
+{
+}
+
+// the isovalues in ascending order and the surfaces of the result in
+// the same order, so the caller's order is kept
+static void sortIsovalues(const std::vector<uint8_t>& isovalues,
+                          std::vector<Isosurface>& result,
+                          std::vector<uint8_t>& sorted,
+                          std::vector<Isosurface*>& surfaces) {
+  std::vector<size_t> order(isovalues.size());
+  for (size_t i = 0;i<order.size();++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&isovalues](size_t a, size_t b) {
+    return isovalues[a] < isovalues[b];
+  });
+  for (const size_t i : order) {
+    sorted.push_back(isovalues[i]);
+    surfaces.push_back(&result[i]);
+  }
+}
+
+std::vector<Isosurface> Isosurface::extractAll(const Volume& volume,
+                                               const std::vector<uint8_t>& isovalues,
+                                               bool indexed, VertexFormat format) {
+  std::vector<Isosurface> result(isovalues.size(), Isosurface{indexed, format});
+  std::vector<uint8_t> sorted;
+  std::vector<Isosurface*> surfaces;
+  sortIsovalues(isovalues, result, sorted, surfaces);
+  for (Isosurface& surface : result) surface.setBounds(volume, volume.depth);
+  if (volume.depth >= 2)
+    extractBatch(volume, 0, volume.depth, 0, volume.depth-1, sorted, surfaces);
+  return result;
+}
+
+std::vector<Isosurface> Isosurface::extractAll(StreamingVolume& volume,
+                                               const std::vector<uint8_t>& isovalues,
+                                               bool indexed, VertexFormat format) {
+  std::vector<Isosurface> result(isovalues.size(), Isosurface{indexed, format});
+  std::vector<uint8_t> sorted;
+  std::vector<Isosurface*> surfaces;
+  sortIsovalues(isovalues, result, sorted, surfaces);
+  const size_t depth = volume.getLayout().depth;
+  for (Isosurface& surface : result) surface.setBounds(volume.getLayout(), depth);
+  volume.forEachSlab(1, 2, [depth, &sorted, &surfaces](const Volume& slab, size_t zFirst,
+                                                        size_t zStart, size_t zEnd) {
+    size_t cellBegin, cellEnd;
+    if (!slabCells(zFirst, zStart, zEnd, depth, cellBegin, cellEnd)) return;
+    extractBatch(slab, zFirst, depth, cellBegin, cellEnd, sorted, surfaces);
+  });
+  return result;
+}
+
+void Isosurface::setBounds(const Volume& layout, size_t depth) {
+  const Vec3 voxelCount{float(layout.width), float(layout.height), float(depth)};
+  boundsSize = layout.scale*voxelCount/float(layout.maxSize);
+  boundsMin = boundsSize*-0.5f;
+}
+
+bool Isosurface::slabCells(size_t zFirst, size_t zStart, size_t zEnd, size_t depth,
+                           size_t& cellBegin, size_t& cellEnd) {
+  // the last slice of the volume starts no cell
+  zEnd = std::min(zEnd, depth-1);
+  if (zStart >= zEnd) return false;
+  cellBegin = zStart-zFirst;
+  cellEnd = zEnd-zFirst;
+  return true;
+}
+
+// the unit vector n mapped to the octahedron |x|+|y|+|z| = 1, whose lower
+// half is folded over the upper one, as two signed normalized values
+static void octahedralEncode(const Vec3& n, int16_t& x, int16_t& y) {
+  const float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+  float u = (length > 0.0f) ? n.x/length : 0.0f;
+  float v = (length > 0.0f) ? n.y/length : 0.0f;
+  if (n.z < 0.0f) {
+    const float foldedU = (1.0f-std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+    const float foldedV = (1.0f-std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+    u = foldedU;
+    v = foldedV;
+  }
+  x = int16_t(std::lround(std::min(std::max(u, -1.0f), 1.0f)*32767.0f));
+  y = int16_t(std::lround(std::min(std::max(v, -1.0f), 1.0f)*32767.0f));
+}
+
+size_t Isosurface::getVertexCount() const {
+  switch (format) {
+    case VertexFormat::Interleaved :
+      return interleaved.size()/interleavedFloats;
+    case VertexFormat::Compact :
+      return compact.size()/compactShorts;
+    default :
+      return vertices.size();
+  }
+}
+
+void Isosurface::resizeVertices(size_t count) {
+  switch (format) {
+    case VertexFormat::Interleaved :
+      interleaved.resize(count*interleavedFloats);
+      break;
+    case VertexFormat::Compact :
+      compact.resize(count*compactShorts);
+      break;
+    default :
+      vertices.resize(count);
+      break;
+  }
+}
+
+void Isosurface::setVertex(size_t index, const Vertex& vertex) {
+  if (format == VertexFormat::Separate) {
+    vertices[index] = vertex;
+    return;
+  }
+  if (format == VertexFormat::Compact) {
+    uint16_t* target = compact.data() + index*compactShorts;
+    for (size_t c = 0;c<3;++c) {
+      const float t = (vertex.position[c]-boundsMin[c])/boundsSize[c];
+      target[c] = uint16_t(std::lround(std::min(std::max(t, 0.0f), 1.0f)*65535.0f));
+    }
+    target[3] = 0;
+    int16_t x, y;
+    octahedralEncode(vertex.normal, x, y);
+    target[4] = uint16_t(x);
+    target[5] = uint16_t(y);
+    return;
+  }
+  float* target = interleaved.data() + index*interleavedFloats;
+  for (size_t c = 0;c<3;++c) {
+    target[c] = vertex.position[c];
+    target[3+c] = vertex.position[c]+0.5f;
+    target[7+c] = vertex.normal[c];
+  }
+  target[6] = 1.0f;
+}
+
+Vec3 Isosurface::getPosition(size_t index) const {
+  if (format == VertexFormat::Separate) return vertices[index].position;
+  if (format == VertexFormat::Compact) {
+    const uint16_t* source = compact.data() + index*compactShorts;
+    return boundsMin + boundsSize * Vec3{float(source[0]), float(source[1]),
+                                         float(source[2])} / 65535.0f;
+  }
+  const float* source = interleaved.data() + index*interleavedFloats;
+  return Vec3{source[0], source[1], source[2]};
+}
+
+Vertex Isosurface::getVertex(size_t index) const {
+  if (format == VertexFormat::Separate) return vertices[index];
+  if (format == VertexFormat::Compact) {
+    const uint16_t* source = compact.data() + index*compactShorts;
+    const Vec2 encoded{float(int16_t(source[4]))/32767.0f,
+                       float(int16_t(source[5]))/32767.0f};
+    return Vertex{getPosition(index), Octahedral::decode(encoded)};
+  }
+  const float* source = interleaved.data() + index*interleavedFloats;
+  return Vertex{getPosition(index), Vec3{source[7], source[8], source[9]}};
+}
+
+void Isosurface::copyVertex(const Isosurface& source, size_t from, size_t to) {
+  switch (format) {
+    case VertexFormat::Interleaved :
+      std::copy_n(source.interleaved.data() + from*interleavedFloats, interleavedFloats,
+                  interleaved.data() + to*interleavedFloats);
+      break;
+    case VertexFormat::Compact :
+      std::copy_n(source.compact.data() + from*compactShorts, compactShorts,
+                  compact.data() + to*compactShorts);
+      break;
+    default :
+      vertices[to] = source.vertices[from];
+      break;
+  }
+}
+
+// the vertex where the isosurface cuts the edge between the voxels a and
+// b, which have the values va and vb and the normals na and nb; always
+// interpolated from the lower voxel, so every cell that shares the edge
+// gets the same vertex
+static Vertex edgeVertex(Vec3 a, Vec3 b, float va, float vb, Vec3 na, Vec3 nb,
+                         float iso, size_t zOffset, const Vec3& origin,
+                         const Vec3& voxelSize) {
+  if (b.x+b.y+b.z < a.x+a.y+a.z) {
+    std::swap(a, b);
+    std::swap(va, vb);
+    std::swap(na, nb);
+  }
+  const float t = (va != vb) ? (iso-va)/(vb-va) : 0.5f;
+  const Vec3 p = a + (b-a)*t;
+  return Vertex{origin + Vec3{p.x, p.y, p.z+float(zOffset)}*voxelSize,
+                Vec3::normalize(na + (nb-na)*t)};
+}
+
+// the same with the normals looked up in slab
+static Vertex edgeVertex(const Volume& slab, Vec3 a, Vec3 b,
+                         float va, float vb, float iso, size_t zOffset,
+                         const Vec3& origin, const Vec3& voxelSize) {
+  return edgeVertex(a, b, va, vb,
+                    slab.getNormal(size_t(a.x), size_t(a.y), size_t(a.z)),
+                    slab.getNormal(size_t(b.x), size_t(b.y), size_t(b.z)),
+                    iso, zOffset, origin, voxelSize);
+}
+
+// the corner values of cell (x, y, z) and its index into the tables
+static uint8_t classifyCell(const Volume& slab, size_t x, size_t y, size_t z,
+                            float iso, std::array<float,8>& values) {
+  const uint8_t* voxels = slab.getData();
+  const size_t sliceSize = slab.width*slab.height;
+  uint8_t cubeIndex = 0;
+  for (uint8_t i = 0;i<8;++i) {
+    const Vec3& corner = vertexPosTable[i];
+    values[i] = float(voxels[x+size_t(corner.x) + (y+size_t(corner.y))*slab.width +
+                             (z+size_t(corner.z))*sliceSize]);
+    if (values[i] < iso) cubeIndex |= uint8_t(1 << i);
+  }
+  return cubeIndex;
+}
+
+// vertex indices of one isovalue: of the x/y edges of the slices below
+// and above the current cell layer, at axis*sliceSize + slot, and of the
+// z edges in between; only the entries that were set are reset, so a
+// cache costs time in proportion to its vertices rather than the slice
+// and can be reused for the next work item
+struct EdgeCache {
+  std::vector<uint32_t> lower, upper, vertical;
+  std::vector<uint32_t> lowerSet, upperSet, verticalSet;
+
+  static void reset(std::vector<uint32_t>& slots, std::vector<uint32_t>& set) {
+    for (const uint32_t slot : set) slots[slot] = noVertex;
+    set.clear();
+  }
+};
+
+// triangles of the cells between slices z and z+1 of slab for z in
+// [zStart, zEnd) for each of the ascending isovalues into the mesh of
+// the same index; every cell is loaded once, its value range selects the
+// isovalues that cut it and their vertices share the corner normals;
+// positions are those of the whole volume, centered around the origin
+// and scaled like the raycaster's volume cube; when indexed, the
+// vertices are shared through one edge cache per isovalue and with
+// deferLastSlice the x and y edges of slice zEnd are left to the next
+// work item
+static void extractCells(const Volume& slab, size_t zOffset, size_t depth,
+                         const std::vector<uint8_t>& isovalues,
+                         size_t zStart, size_t zEnd, bool indexed, bool deferLastSlice,
+                         std::vector<EdgeCache>& caches, std::vector<SlabMesh>& meshes) {
+  const Vec3 voxelCount{float(slab.width), float(slab.height), float(depth)};
+  const Vec3 extent = slab.scale*voxelCount/float(slab.maxSize);
+  const Vec3 voxelSize = extent/voxelCount;
+  const Vec3 origin = voxelSize*0.5f - extent*0.5f;
+  const uint8_t* voxels = slab.getData();
+  const size_t sliceSize = slab.width*slab.height;
+
+  std::array<size_t,8> cornerOffsets;
+  for (uint8_t i = 0;i<8;++i) {
+    const Vec3& corner = vertexPosTable[i];
+    cornerOffsets[i] = size_t(corner.x) + size_t(corner.y)*slab.width +
+                       size_t(corner.z)*sliceSize;
+  }
+
+  if (indexed) {
+    for (EdgeCache& cache : caches) {
+      if (!cache.lower.empty()) continue;
+      cache.lower.assign(2*sliceSize, noVertex);
+      cache.upper.assign(2*sliceSize, noVertex);
+      cache.vertical.assign(sliceSize, noVertex);
+    }
+  }
+
+  for (size_t z = zStart;z<zEnd;++z) {
+    for (size_t y = 0;y+1<slab.height;++y) {
+      for (size_t x = 0;x+1<slab.width;++x) {
+        const uint8_t* cellVoxels = voxels + x + y*slab.width + z*sliceSize;
+        std::array<uint8_t,8> corners;
+        uint8_t minValue = 255, maxValue = 0;
+        for (uint8_t i = 0;i<8;++i) {
+          corners[i] = cellVoxels[cornerOffsets[i]];
+          minValue = std::min(minValue, corners[i]);
+          maxValue = std::max(maxValue, corners[i]);
+        }
+        // the cell is cut by the isovalues in (minValue, maxValue]
+        const size_t first = size_t(std::upper_bound(isovalues.begin(), isovalues.end(), minValue) -
+                                    isovalues.begin());
+        if (first == isovalues.size() || isovalues[first] > maxValue) continue;
+
+        std::array<float,8> values;
+        for (uint8_t i = 0;i<8;++i) values[i] = float(corners[i]);
+        const Vec3 cell{float(x),float(y),float(z)};
+        // the gradients are looked up once per corner for all isovalues
+        std::array<Vec3,8> normals;
+        uint8_t normalsLoaded = 0;
+        const auto computeVertex = [&](uint8_t e, float iso) {
+          const uint8_t a = edgeToVertexTable[e][0];
+          const uint8_t b = edgeToVertexTable[e][1];
+          for (const uint8_t c : {a, b}) {
+            if (normalsLoaded & (1 << c)) continue;
+            const Vec3& corner = vertexPosTable[c];
+            normals[c] = slab.getNormal(x+size_t(corner.x), y+size_t(corner.y), z+size_t(corner.z));
+            normalsLoaded |= uint8_t(1 << c);
+          }
+          return edgeVertex(cell + vertexPosTable[a], cell + vertexPosTable[b], values[a], values[b],
+                            normals[a], normals[b], iso, zOffset, origin, voxelSize);
+        };
+
+        for (size_t s = first;s<isovalues.size() && isovalues[s] <= maxValue;++s) {
+          const float iso = float(isovalues[s]);
+          SlabMesh& mesh = meshes[s];
+          uint8_t cubeIndex = 0;
+          for (uint8_t i = 0;i<8;++i)
+            if (values[i] < iso) cubeIndex |= uint8_t(1 << i);
+
+          // vertexPosTable mirrors y compared to the original tables, so the
+          // triangles are flipped to wind counter clockwise around the normal
+          const std::array<uint8_t,16>& tris = trisTable[cubeIndex];
+          if (!indexed) {
+            std::array<Vertex,12> edgeVertices;
+            for (uint8_t e = 0;e<12;++e)
+              if (edgeTable[cubeIndex] & (1 << e)) edgeVertices[e] = computeVertex(e, iso);
+            for (uint8_t i = 0;tris[i] != N_E;i += 3) {
+              mesh.vertices.push_back(edgeVertices[tris[i]]);
+              mesh.vertices.push_back(edgeVertices[tris[i+2]]);
+              mesh.vertices.push_back(edgeVertices[tris[i+1]]);
+            }
+            continue;
+          }
+
+          EdgeCache& cache = caches[s];
+          std::array<uint32_t,12> edgeIndices;
+          for (uint8_t e = 0;e<12;++e) {
+            if (!(edgeTable[cubeIndex] & (1 << e))) continue;
+            const CellEdge& edge = cellEdges[e];
+            const size_t slot = x+edge.dx + (y+edge.dy)*slab.width;
+            const uint32_t key = uint32_t(edge.axis*sliceSize + slot);
+            const bool vertical = edge.axis == 2;
+            std::vector<uint32_t>& slots = vertical ? cache.vertical
+                                         : (edge.dz == 0 ? cache.lower : cache.upper);
+            std::vector<uint32_t>& set = vertical ? cache.verticalSet
+                                       : (edge.dz == 0 ? cache.lowerSet : cache.upperSet);
+            uint32_t& cached = slots[vertical ? slot : key];
+            if (cached == noVertex) {
+              set.push_back(vertical ? uint32_t(slot) : key);
+              if (edge.axis != 2 && edge.dz == 1 && deferLastSlice && z+1 == zEnd) {
+                cached = deferredFlag | key;
+              } else {
+                cached = uint32_t(mesh.vertices.size());
+                mesh.vertices.push_back(computeVertex(e, iso));
+                if (edge.axis != 2 && edge.dz == 0 && z == zStart)
+                  mesh.firstSliceEdges.push_back(std::make_pair(key, cached));
+              }
+            }
+            edgeIndices[e] = cached;
+          }
+          for (uint8_t i = 0;tris[i] != N_E;i += 3) {
+            for (const uint8_t e : {tris[i], tris[i+2], tris[i+1]}) {
+              if (edgeIndices[e] & deferredFlag) mesh.deferred.push_back(mesh.indices.size());
+              mesh.indices.push_back(edgeIndices[e]);
+            }
+          }
+        }
+      }
+    }
+    if (indexed) {
+      for (EdgeCache& cache : caches) {
+        EdgeCache::reset(cache.lower, cache.lowerSet);
+        std::swap(cache.lower, cache.upper);
+        std::swap(cache.lowerSet, cache.upperSet);
+        EdgeCache::reset(cache.vertical, cache.verticalSet);
+      }
+    }
+  }
+  // leave the caches empty for the next work item
+  for (EdgeCache& cache : caches) EdgeCache::reset(cache.lower, cache.lowerSet);
+  for (SlabMesh& mesh : meshes) std::sort(mesh.firstSliceEdges.begin(), mesh.firstSliceEdges.end());
+}
+
+void Isosurface::extract(const Volume& slab, size_t zOffset, size_t depth,
+                         size_t cellBegin, size_t cellEnd, uint8_t isovalue) {
+  extractBatch(slab, zOffset, depth, cellBegin, cellEnd, std::vector<uint8_t>{isovalue},
+               std::vector<Isosurface*>{this});
+}
+
+void Isosurface::extractBatch(const Volume& slab, size_t zOffset, size_t depth,
+                              size_t cellBegin, size_t cellEnd,
+                              const std::vector<uint8_t>& isovalues,
+                              const std::vector<Isosurface*>& surfaces) {
+  if (slab.width < 2 || slab.height < 2 || cellBegin >= cellEnd || isovalues.empty()) return;
+  const bool indexed = surfaces.front()->indexed;
+
+  // every work item extracts into its own buffers, a prefix sum over
+  // their sizes then gives each its place in the result, so the output
+  // order does not depend on the thread count or scheduling
+  const size_t cellLayers = cellEnd-cellBegin;
+  const size_t itemCount = (cellLayers+slabDepth-1)/slabDepth;
+  std::vector<std::vector<SlabMesh>> meshes(itemCount, std::vector<SlabMesh>(isovalues.size()));
+#pragma omp parallel
+  {
+    // the edge caches of a thread, allocated once and handed back empty
+    // by every work item
+    std::vector<EdgeCache> caches(indexed ? isovalues.size() : 0);
+#pragma omp for schedule(dynamic)
+    for (int64_t i = 0;i<int64_t(itemCount);++i) {
+      const size_t zStart = cellBegin + size_t(i)*slabDepth;
+      extractCells(slab, zOffset, depth, isovalues, zStart,
+                   std::min(zStart+slabDepth, cellEnd),
+                   indexed, size_t(i)+1 < itemCount, caches, meshes[size_t(i)]);
+    }
+  }
+
+  for (size_t s = 0;s<surfaces.size();++s) {
+    Isosurface& surface = *surfaces[s];
+    std::vector<size_t> vertexOffsets(itemCount+1, surface.getVertexCount());
+    std::vector<size_t> indexOffsets(itemCount+1, surface.indices.size());
+    for (size_t i = 0;i<itemCount;++i) {
+      vertexOffsets[i+1] = vertexOffsets[i] + meshes[i][s].vertices.size();
+      indexOffsets[i+1] = indexOffsets[i] + meshes[i][s].indices.size();
+    }
+    surface.resizeVertices(vertexOffsets[itemCount]);
+    surface.indices.resize(indexOffsets[itemCount]);
+
+#pragma omp parallel for
+    for (int64_t i = 0;i<int64_t(itemCount);++i) {
+      const SlabMesh& mesh = meshes[size_t(i)][s];
+      for (size_t j = 0;j<mesh.vertices.size();++j)
+        surface.setVertex(vertexOffsets[size_t(i)] + j, mesh.vertices[j]);
+
+      uint32_t* target = surface.indices.data() + indexOffsets[size_t(i)];
+      const uint32_t offset = uint32_t(vertexOffsets[size_t(i)]);
+      for (size_t j = 0;j<mesh.indices.size();++j) target[j] = mesh.indices[j] + offset;
+
+      // the edges of the last slice were created by the next work item
+      if (mesh.deferred.empty()) continue;
+      const SlabMesh& next = meshes[size_t(i)+1][s];
+      const uint32_t nextOffset = uint32_t(vertexOffsets[size_t(i)+1]);
+      for (const size_t j : mesh.deferred) {
+        const uint32_t key = mesh.indices[j] & ~deferredFlag;
+        const auto entry = std::lower_bound(next.firstSliceEdges.begin(), next.firstSliceEdges.end(),
+                                            std::make_pair(key, uint32_t(0)));
+        target[j] = entry->second + nextOffset;
+      }
+    }
+    // the meshes of this isovalue are not needed anymore
+    for (size_t i = 0;i<itemCount;++i) meshes[i][s] = SlabMesh{};
+  }
+}
+
+// the output of one brick of extractBricks
+struct BrickMesh {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  // (key, vertex) of the edges on the lower faces of the brick, sorted by
+  // key; the bricks below resolve their foreign edges through it
+  std::vector<std::pair<uint64_t,uint32_t>> lowerFaceEdges;
+  // (position in indices, key) of the edges on the upper faces that
+  // belong to a neighboring brick
+  std::vector<std::pair<size_t,uint64_t>> foreign;
+};
+
+// the cells of an octree brick, read from the flat volume
+struct FlatBrickCells {
+  const Volume& volume;
+
+  uint8_t classify(size_t x, size_t y, size_t z, float iso, std::array<float,8>& values) const {
+    return classifyCell(volume, x, y, z, iso, values);
+  }
+
+  Vec3 getNormal(size_t x, size_t y, size_t z) const {
+    return volume.getNormal(x, y, z);
+  }
+};
+
+// the cells of a brick of a bricked volume, read from its consecutive
+// voxels and apron only
+struct BrickedBrickCells {
+  BrickedBrickCells(const BrickedVolume& bricks, size_t brick) :
+    bricks{bricks},
+    brick{brick}
+  {
+    bricks.getBrickOrigin(brick, x0, y0, z0);
+    const size_t stored = bricks.storedSize;
+    for (uint8_t i = 0;i<8;++i) {
+      const Vec3& corner = vertexPosTable[i];
+      cornerOffsets[i] = size_t(corner.x) + (size_t(corner.y) + size_t(corner.z)*stored)*stored;
+    }
+  }
+
+  uint8_t classify(size_t x, size_t y, size_t z, float iso, std::array<float,8>& values) const {
+    const size_t stored = bricks.storedSize;
+    const size_t apron = BrickedVolume::apron;
+    const uint8_t* cell = bricks.getBrick(brick) + (x-x0+apron) +
+                          ((y-y0+apron) + (z-z0+apron)*stored)*stored;
+    uint8_t cubeIndex = 0;
+    for (uint8_t i = 0;i<8;++i) {
+      values[i] = float(cell[cornerOffsets[i]]);
+      if (values[i] < iso) cubeIndex |= uint8_t(1 << i);
+    }
+    return cubeIndex;
+  }
+
+  Vec3 getNormal(size_t x, size_t y, size_t z) const {
+    return bricks.computeNormal(brick, int64_t(x-x0), int64_t(y-y0), int64_t(z-z0));
+  }
+
+  const BrickedVolume& bricks;
+  size_t brick;
+  size_t x0, y0, z0;
+  std::array<size_t,8> cornerOffsets;
+};
+
+static FlatBrickCells brickCells(const Volume& volume, const MinMaxOctree&, size_t) {
+  return FlatBrickCells{volume};
+}
+
+static BrickedBrickCells brickCells(const Volume&, const BrickedVolume& bricks, size_t brick) {
+  return BrickedBrickCells{bricks, brick};
+}
+
+// the triangles of the cells of a brick; when indexed, every brick
+// creates the vertices of the edges that start at the voxels it owns and
+// leaves the others to their neighbors
+template <typename Bricks>
+static void extractBrick(const Volume& volume, const Bricks& bricks,
+                         size_t brick, uint8_t isovalue, bool indexed,
+                         BrickMesh& mesh) {
+  const Vec3 voxelCount{float(volume.width), float(volume.height), float(volume.depth)};
+  const Vec3 extent = volume.scale*voxelCount/float(volume.maxSize);
+  const Vec3 voxelSize = extent/voxelCount;
+  const Vec3 origin = voxelSize*0.5f - extent*0.5f;
+  const float iso = float(isovalue);
+  const size_t sliceSize = volume.width*volume.height;
+
+  const auto cells = brickCells(volume, bricks, brick);
+
+  const size_t size = bricks.brickSize;
+  const size_t x0 = (brick % bricks.bricksX)*size;
+  const size_t y0 = ((brick / bricks.bricksX) % bricks.bricksY)*size;
+  const size_t z0 = (brick / (bricks.bricksX*bricks.bricksY))*size;
+  const size_t x1 = std::min(x0+size, volume.width-1);
+  const size_t y1 = std::min(y0+size, volume.height-1);
+  const size_t z1 = std::min(z0+size, volume.depth-1);
+
+  // vertex indices of the edges starting at the size+1 voxels per axis
+  // of the brick, three per voxel
+  const size_t side = size+1;
+  std::vector<uint32_t> cache(indexed ? side*side*side*3 : 0, noVertex);
+
+  for (size_t z = z0;z<z1;++z) {
+    for (size_t y = y0;y<y1;++y) {
+      for (size_t x = x0;x<x1;++x) {
+        std::array<float,8> values;
+        const uint8_t cubeIndex = cells.classify(x, y, z, iso, values);
+        if (edgeTable[cubeIndex] == 0) continue;
+
+        const auto computeVertex = [&](uint8_t e) {
+          const uint8_t a = edgeToVertexTable[e][0];
+          const uint8_t b = edgeToVertexTable[e][1];
+          const Vec3 cell{float(x),float(y),float(z)};
+          const Vec3 pa = cell + vertexPosTable[a], pb = cell + vertexPosTable[b];
+          return edgeVertex(pa, pb, values[a], values[b],
+                            cells.getNormal(size_t(pa.x), size_t(pa.y), size_t(pa.z)),
+                            cells.getNormal(size_t(pb.x), size_t(pb.y), size_t(pb.z)),
+                            iso, 0, origin, voxelSize);
+        };
+
+        // flipped like in extractCells
+        const std::array<uint8_t,16>& tris = trisTable[cubeIndex];
+        if (!indexed) {
+          std::array<Vertex,12> edgeVertices;
+          for (uint8_t e = 0;e<12;++e)
+            if (edgeTable[cubeIndex] & (1 << e)) edgeVertices[e] = computeVertex(e);
+          for (uint8_t i = 0;tris[i] != N_E;i += 3) {
+            mesh.vertices.push_back(edgeVertices[tris[i]]);
+            mesh.vertices.push_back(edgeVertices[tris[i+2]]);
+            mesh.vertices.push_back(edgeVertices[tris[i+1]]);
+          }
+          continue;
+        }
+
+        std::array<uint32_t,12> edgeIndices;
+        std::array<uint64_t,12> edgeKeys;
+        for (uint8_t e = 0;e<12;++e) {
+          if (!(edgeTable[cubeIndex] & (1 << e))) continue;
+          const CellEdge& edge = cellEdges[e];
+          const size_t ex = x+edge.dx, ey = y+edge.dy, ez = z+edge.dz;
+          edgeKeys[e] = uint64_t(ex + ey*volume.width + ez*sliceSize)*3 + edge.axis;
+          uint32_t& cached = cache[((ex-x0) + ((ey-y0) + (ez-z0)*side)*side)*3 + edge.axis];
+          if (cached == noVertex) {
+            if (bricks.getBrickIndex(ex, ey, ez) != brick) {
+              cached = deferredFlag;
+            } else {
+              cached = uint32_t(mesh.vertices.size());
+              mesh.vertices.push_back(computeVertex(e));
+              if (ex == x0 || ey == y0 || ez == z0)
+                mesh.lowerFaceEdges.push_back(std::make_pair(edgeKeys[e], cached));
+            }
+          }
+          edgeIndices[e] = cached;
+        }
+        for (uint8_t i = 0;tris[i] != N_E;i += 3) {
+          for (const uint8_t e : {tris[i], tris[i+2], tris[i+1]}) {
+            if (edgeIndices[e] == deferredFlag)
+              mesh.foreign.push_back(std::make_pair(mesh.indices.size(), edgeKeys[e]));
+            mesh.indices.push_back(edgeIndices[e]);
+          }
+        }
+      }
+    }
+  }
+  std::sort(mesh.lowerFaceEdges.begin(), mesh.lowerFaceEdges.end());
+}
+
+template <typename Bricks>
+void Isosurface::extractBricks(const Volume& volume, const Bricks& grid,
+                               uint8_t isovalue) {
+  const std::vector<uint32_t> bricks = grid.activeBricks(isovalue);
+  std::vector<BrickMesh> meshes(bricks.size());
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t i = 0;i<int64_t(bricks.size());++i)
+    extractBrick(volume, grid, bricks[size_t(i)], isovalue, indexed, meshes[size_t(i)]);
+
+  std::vector<size_t> vertexOffsets(bricks.size()+1, getVertexCount());
+  std::vector<size_t> indexOffsets(bricks.size()+1, indices.size());
+  for (size_t i = 0;i<bricks.size();++i) {
+    vertexOffsets[i+1] = vertexOffsets[i] + meshes[i].vertices.size();
+    indexOffsets[i+1] = indexOffsets[i] + meshes[i].indices.size();
+  }
+  resizeVertices(vertexOffsets[bricks.size()]);
+  indices.resize(indexOffsets[bricks.size()]);
+
+#pragma omp parallel for
+  for (int64_t i = 0;i<int64_t(bricks.size());++i) {
+    const BrickMesh& mesh = meshes[size_t(i)];
+    for (size_t j = 0;j<mesh.vertices.size();++j)
+      setVertex(vertexOffsets[size_t(i)] + j, mesh.vertices[j]);
+
+    uint32_t* target = indices.data() + indexOffsets[size_t(i)];
+    const uint32_t offset = uint32_t(vertexOffsets[size_t(i)]);
+    for (size_t j = 0;j<mesh.indices.size();++j) target[j] = mesh.indices[j] + offset;
+
+    // the owner of a foreign edge contains it too, so it is active as well
+    for (const auto& edge : mesh.foreign) {
+      const size_t voxel = size_t(edge.second/3);
+      const size_t owner = grid.getBrickIndex(voxel % volume.width,
+                                              (voxel / volume.width) % volume.height,
+                                              voxel / (volume.width*volume.height));
+      const size_t o = size_t(std::lower_bound(bricks.begin(), bricks.end(), uint32_t(owner)) -
+                              bricks.begin());
+      const BrickMesh& ownerMesh = meshes[o];
+      const auto entry = std::lower_bound(ownerMesh.lowerFaceEdges.begin(),
+                                          ownerMesh.lowerFaceEdges.end(),
+                                          std::make_pair(edge.second, uint32_t(0)));
+      target[edge.first] = entry->second + uint32_t(vertexOffsets[o]);
+    }
+  }
+}
+
+// a cell corner as its offset within the cell
+struct CellCorner {
+  size_t dx, dy, dz;
+};
+
+static std::array<CellCorner,8> computeCellCorners() {
+  std::array<CellCorner,8> corners;
+  for (size_t c = 0;c<8;++c)
+    corners[c] = CellCorner{size_t(vertexPosTable[c].x), size_t(vertexPosTable[c].y),
+                            size_t(vertexPosTable[c].z)};
+  return corners;
+}
+
+static const std::array<CellCorner,8> cellCorners = computeCellCorners();
+
+static std::array<uint8_t,256> computeTriangleCounts() {
+  std::array<uint8_t,256> counts;
+  for (size_t c = 0;c<256;++c) {
+    uint8_t count = 0;
+    while (count*3 < 15 && trisTable[c][count*3] != N_E) ++count;
+    counts[c] = count;
+  }
+  return counts;
+}
+
+static const std::array<uint8_t,256> triangleCounts = computeTriangleCounts();
+
+// what extractFlyingEdges knows about one row of voxels along x
+struct EdgeRow {
+  // the crossing x edges lie in [xMin, xMax)
+  size_t xMin, xMax;
+  // crossings of the x edges and of the y and z edges starting in the row
+  size_t xCount, yCount, zCount;
+  size_t triangleCount;
+  size_t firstVertex, firstTriangle;
+};
+
+// the x edge cases of the rows (y+dy, z+dz) at the same x, indexed by
+// dy + 2*dz, bit 0 of an x edge case is set if its first voxel lies
+// below the isovalue and bit 1 if its second does
+typedef std::array<uint8_t,4> CellCases;
+
+static uint8_t cubeIndex(const CellCases& cases) {
+  uint8_t index = 0;
+  for (uint8_t c = 0;c<8;++c) {
+    const CellCorner& corner = cellCorners[c];
+    if ((cases[corner.dy + 2*corner.dz] >> corner.dx) & 1) index |= uint8_t(1 << c);
+  }
+  return index;
+}
+
+static bool crosses(uint8_t edgeCase) {
+  return edgeCase == 1 || edgeCase == 2;
+}
+
+// Flying Edges (Schroeder et al. 2015): the same triangles as extract,
+// computed in four passes over the rows of voxels along x, all but the
+// third in parallel; the first classifies the x edges, the second counts
+// the crossings of the y and z edges and the triangles of every row, a
+// prefix sum over these counts gives every row its place in the output
+// and the fourth pass writes vertices and indices there exactly once
+void Isosurface::extractFlyingEdges(const Volume& slab, size_t zOffset, size_t depth,
+                                    size_t cellBegin, size_t cellEnd, uint8_t isovalue) {
+  // only the slices [cellBegin, cellEnd] take part, z counts from cellBegin
+  const size_t nx = slab.width, ny = slab.height;
+  if (nx < 2 || ny < 2 || cellBegin >= cellEnd) return;
+  const size_t nz = cellEnd-cellBegin+1;
+  const Vec3 sliceOffset{0.0f, 0.0f, float(cellBegin)};
+
+  const Vec3 voxelCount{float(nx), float(ny), float(depth)};
+  const Vec3 extent = slab.scale*voxelCount/float(slab.maxSize);
+  const Vec3 voxelSize = extent/voxelCount;
+  const Vec3 origin = voxelSize*0.5f - extent*0.5f;
+  const float iso = float(isovalue);
+  const uint8_t* voxels = slab.getData() + cellBegin*nx*ny;
+  const size_t rowCount = ny*nz;
+
+  // pass 1: the x edge cases and the range of crossing x edges per row
+  std::vector<uint8_t> edgeCases((nx-1)*rowCount);
+  std::vector<EdgeRow> rows(rowCount);
+#pragma omp parallel for
+  for (int64_t r = 0;r<int64_t(rowCount);++r) {
+    const uint8_t* row = voxels + size_t(r)*nx;
+    uint8_t* cases = edgeCases.data() + size_t(r)*(nx-1);
+    EdgeRow& info = rows[size_t(r)];
+    info = EdgeRow{nx, 0, 0, 0, 0, 0, 0, 0};
+    for (size_t i = 0;i+1<nx;++i) {
+      cases[i] = uint8_t((row[i] < isovalue ? 1 : 0) | (row[i+1] < isovalue ? 2 : 0));
+      if (crosses(cases[i])) {
+        info.xMin = std::min(info.xMin, i);
+        info.xMax = i+1;
+        ++info.xCount;
+      }
+    }
+  }
+
+  const auto below = [&](size_t r, size_t p) -> bool {
+    const uint8_t* cases = edgeCases.data() + r*(nx-1);
+    return (p+1 < nx) ? (cases[p] & 1) != 0 : (cases[nx-2] & 2) != 0;
+  };
+
+  // the points [xL, xR] outside of which the given rows have no crossing
+  // along any axis; beyond their x crossings the rows are constant, so
+  // the edges between them only cross there if their end points differ
+  const auto trim = [&](const size_t* rowIds, size_t count, size_t& xL, size_t& xR) {
+    xL = nx;
+    xR = 0;
+    for (size_t c = 0;c<count;++c) {
+      xL = std::min(xL, rows[rowIds[c]].xMin);
+      xR = std::max(xR, rows[rowIds[c]].xMax);
+    }
+    for (size_t c = 1;c<count;++c) {
+      if (below(rowIds[c], 0) != below(rowIds[0], 0)) xL = 0;
+      if (below(rowIds[c], nx-1) != below(rowIds[0], nx-1)) xR = nx-1;
+    }
+  };
+
+  const auto gatherCases = [&](const size_t* quad, size_t i) {
+    CellCases cases;
+    for (size_t q = 0;q<4;++q) cases[q] = edgeCases[quad[q]*(nx-1) + i];
+    return cases;
+  };
+
+  // pass 2: the crossings of the y and z edges starting in each row and
+  // the triangles of the cells between the row and its y and z neighbors
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int64_t rr = 0;rr<int64_t(rowCount);++rr) {
+    const size_t r = size_t(rr), j = r % ny, k = r / ny;
+    EdgeRow& info = rows[r];
+    size_t xL, xR;
+    if (j+1 < ny) {
+      const size_t pair[2] = {r, r+1};
+      trim(pair, 2, xL, xR);
+      for (size_t p = xL;p<=xR;++p) if (below(r, p) != below(r+1, p)) ++info.yCount;
+    }
+    if (k+1 < nz) {
+      const size_t pair[2] = {r, r+ny};
+      trim(pair, 2, xL, xR);
+      for (size_t p = xL;p<=xR;++p) if (below(r, p) != below(r+ny, p)) ++info.zCount;
+    }
+    if (j+1 < ny && k+1 < nz) {
+      const size_t quad[4] = {r, r+1, r+ny, r+1+ny};
+      trim(quad, 4, xL, xR);
+      for (size_t i = xL;i<xR;++i)
+        info.triangleCount += triangleCounts[cubeIndex(gatherCases(quad, i))];
+    }
+  }
+
+  // pass 3: every row's first vertex and triangle; an indexed surface is
+  // written straight into the result, a triangle soup is expanded from
+  // a temporary indexed one
+  const size_t vertexOffset = indexed ? getVertexCount() : 0;
+  size_t vertexCount = vertexOffset;
+  size_t triangleCount = 0;
+  for (EdgeRow& info : rows) {
+    info.firstVertex = vertexCount;
+    info.firstTriangle = triangleCount;
+    vertexCount += info.xCount + info.yCount + info.zCount;
+    triangleCount += info.triangleCount;
+  }
+
+  std::vector<Vertex> soupVertices;
+  std::vector<uint32_t> soupIndices;
+  uint32_t* indexTarget;
+  if (indexed) {
+    const size_t firstIndex = indices.size();
+    resizeVertices(vertexCount);
+    indices.resize(firstIndex + triangleCount*3);
+    indexTarget = indices.data() + firstIndex;
+  } else {
+    soupVertices.resize(vertexCount);
+    soupIndices.resize(triangleCount*3);
+    indexTarget = soupIndices.data();
+  }
+
+  // pass 4: the vertices of each row's crossings in the order x, y, z,
+  // then the triangles of its cells; running counters of the crossings
+  // passed so far on each of the cell's edge rows give the vertex indices
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int64_t rr = 0;rr<int64_t(rowCount);++rr) {
+    const size_t r = size_t(rr), j = r % ny, k = r / ny;
+    const EdgeRow& info = rows[r];
+    const uint8_t* row = voxels + r*nx;
+    const float y = float(j), z = float(k);
+
+    const auto writeVertex = [&](size_t id, const Vec3& a, const Vec3& b, uint8_t va, uint8_t vb) {
+      const Vertex vertex = edgeVertex(slab, a+sliceOffset, b+sliceOffset, float(va), float(vb),
+                                       iso, zOffset, origin, voxelSize);
+      if (indexed)
+        setVertex(id, vertex);
+      else
+        soupVertices[id] = vertex;
+    };
+
+    size_t id = info.firstVertex;
+    const uint8_t* cases = edgeCases.data() + r*(nx-1);
+    for (size_t i = info.xMin;i<info.xMax;++i)
+      if (crosses(cases[i]))
+        writeVertex(id++, Vec3{float(i),y,z}, Vec3{float(i+1),y,z}, row[i], row[i+1]);
+
+    size_t xL, xR;
+    if (j+1 < ny) {
+      const size_t pair[2] = {r, r+1};
+      trim(pair, 2, xL, xR);
+      for (size_t p = xL;p<=xR;++p)
+        if (below(r, p) != below(r+1, p))
+          writeVertex(id++, Vec3{float(p),y,z}, Vec3{float(p),y+1,z}, row[p], row[p+nx]);
+    }
+    if (k+1 < nz) {
+      const size_t pair[2] = {r, r+ny};
+      trim(pair, 2, xL, xR);
+      for (size_t p = xL;p<=xR;++p)
+        if (below(r, p) != below(r+ny, p))
+          writeVertex(id++, Vec3{float(p),y,z}, Vec3{float(p),y,z+1}, row[p], row[p+nx*ny]);
+    }
+
+    if (info.triangleCount == 0) continue;
+
+    // the rows (j+dy, k+dz) at dy + 2*dz, the y edges of the cell start
+    // in the rows (j, k+dz) and the z edges in the rows (j+dy, k)
+    const size_t quad[4] = {r, r+1, r+ny, r+1+ny};
+    size_t xBase[4], yBase[2], zBase[2];
+    for (size_t q = 0;q<4;++q) xBase[q] = rows[quad[q]].firstVertex;
+    for (size_t d = 0;d<2;++d) {
+      yBase[d] = rows[quad[2*d]].firstVertex + rows[quad[2*d]].xCount;
+      zBase[d] = rows[quad[d]].firstVertex + rows[quad[d]].xCount + rows[quad[d]].yCount;
+    }
+    size_t xCounter[4] = {0, 0, 0, 0}, yCounter[2] = {0, 0}, zCounter[2] = {0, 0};
+
+    uint32_t* target = indexTarget + info.firstTriangle*3;
+    trim(quad, 4, xL, xR);
+    for (size_t i = xL;i<xR;++i) {
+      const CellCases cellCases = gatherCases(quad, i);
+      // bit 0 for the crossing at x = i, bit 1 for the one at x = i+1
+      const uint8_t yCrossings[2] = {uint8_t(cellCases[0] ^ cellCases[1]),
+                                     uint8_t(cellCases[2] ^ cellCases[3])};
+      const uint8_t zCrossings[2] = {uint8_t(cellCases[0] ^ cellCases[2]),
+                                     uint8_t(cellCases[1] ^ cellCases[3])};
+
+      const uint8_t index = cubeIndex(cellCases);
+      if (edgeTable[index] != 0) {
+        std::array<uint32_t,12> edgeIndices;
+        for (uint8_t e = 0;e<12;++e) {
+          if (!(edgeTable[index] & (1 << e))) continue;
+          const CellEdge& edge = cellEdges[e];
+          size_t v;
+          if (edge.axis == 0)
+            v = xBase[edge.dy + 2*edge.dz] + xCounter[edge.dy + 2*edge.dz];
+          else if (edge.axis == 1)
+            v = yBase[edge.dz] + yCounter[edge.dz] + (edge.dx ? (yCrossings[edge.dz] & 1) : 0);
+          else
+            v = zBase[edge.dy] + zCounter[edge.dy] + (edge.dx ? (zCrossings[edge.dy] & 1) : 0);
+          edgeIndices[e] = uint32_t(v);
+        }
+        // flipped like in extractCells
+        const std::array<uint8_t,16>& tris = trisTable[index];
+        for (uint8_t t = 0;tris[t] != N_E;t += 3) {
+          *target++ = edgeIndices[tris[t]];
+          *target++ = edgeIndices[tris[t+2]];
+          *target++ = edgeIndices[tris[t+1]];
+        }
+      }
+
+      for (size_t q = 0;q<4;++q) xCounter[q] += crosses(cellCases[q]) ? 1 : 0;
+      for (size_t d = 0;d<2;++d) {
+        yCounter[d] += yCrossings[d] & 1;
+        zCounter[d] += zCrossings[d] & 1;
+      }
+    }
+  }
+
+  if (indexed) return;
+  const size_t first = getVertexCount();
+  resizeVertices(first + soupIndices.size());
+#pragma omp parallel for
+  for (int64_t i = 0;i<int64_t(soupIndices.size());++i)
+    setVertex(first + size_t(i), soupVertices[soupIndices[size_t(i)]]);
+}
+
+// triangles per work item of clip; the plane distances of a chunk are
+// computed in one branch free loop over the vertices stored as
+// structure of arrays, so the compiler can vectorize it
+static const size_t clipChunkSize = 4096;
+// vertices closer to the plane than this are snapped onto it, so a
+// triangle that only touches the plane is kept whole instead of
+// producing slivers
+static const float clipEpsilon = 1e-6f;
+
+// the point and normal where the plane cuts the edge from a to b, which
+// lie at the distances da and db on opposite sides of it
+static Vertex cutVertex(const Vertex& a, const Vertex& b, float da, float db) {
+  const float t = da / (da - db);
+  return Vertex{a.position + (b.position - a.position) * t,
+                Vec3::normalize(a.normal + (b.normal - a.normal) * t)};
+}
+
+Isosurface Isosurface::clip(const Vec3& normal, float d) const {
+  Isosurface result{indexed, format};
+  result.algorithm = algorithm;
+  result.boundsMin = boundsMin;
+  result.boundsSize = boundsSize;
+
+  const size_t vertexCount = getVertexCount();
+  const size_t triangleCount = (indexed ? indices.size() : vertexCount) / 3;
+  if (triangleCount == 0) return result;
+
+  // positions as structure of arrays and their signed plane distances
+  std::vector<float> xs(vertexCount), ys(vertexCount), zs(vertexCount);
+#pragma omp parallel for
+  for (int64_t v = 0;v<int64_t(vertexCount);++v) {
+    const Vec3 p = getPosition(size_t(v));
+    xs[size_t(v)] = p.x;
+    ys[size_t(v)] = p.y;
+    zs[size_t(v)] = p.z;
+  }
+  std::vector<float> distances(vertexCount);
+  const int64_t vertexChunks = int64_t((vertexCount+clipChunkSize-1)/clipChunkSize);
+#pragma omp parallel for
+  for (int64_t c = 0;c<vertexChunks;++c) {
+    const size_t begin = size_t(c)*clipChunkSize;
+    const size_t end = std::min(vertexCount, begin+clipChunkSize);
+    const float* x = xs.data();
+    const float* y = ys.data();
+    const float* z = zs.data();
+    float* distance = distances.data();
+    for (size_t v = begin;v<end;++v) {
+      const float dist = normal.x*x[v] + normal.y*y[v] + normal.z*z[v] + d;
+      distance[v] = (std::fabs(dist) < clipEpsilon) ? 0.0f : dist;
+    }
+  }
+
+  // the vertices that are kept keep their order, numbered by chunk
+  std::vector<size_t> keptOffsets(size_t(vertexChunks)+1, 0);
+#pragma omp parallel for
+  for (int64_t c = 0;c<vertexChunks;++c) {
+    const size_t begin = size_t(c)*clipChunkSize;
+    const size_t end = std::min(vertexCount, begin+clipChunkSize);
+    size_t count = 0;
+    for (size_t v = begin;v<end;++v) count += (distances[v] <= 0.0f) ? 1 : 0;
+    keptOffsets[size_t(c)+1] = count;
+  }
+  for (size_t c = 0;c<size_t(vertexChunks);++c) keptOffsets[c+1] += keptOffsets[c];
+  std::vector<uint32_t> remap(vertexCount);
+#pragma omp parallel for
+  for (int64_t c = 0;c<vertexChunks;++c) {
+    const size_t begin = size_t(c)*clipChunkSize;
+    const size_t end = std::min(vertexCount, begin+clipChunkSize);
+    size_t next = keptOffsets[size_t(c)];
+    for (size_t v = begin;v<end;++v)
+      remap[v] = (distances[v] <= 0.0f) ? uint32_t(next++) : noVertex;
+  }
+  const size_t keptCount = keptOffsets[size_t(vertexChunks)];
+
+  // first pass: the triangles every triangle turns into, none if it is
+  // on the far side, and the number of vertices its cut adds
+  const auto corner = [&](size_t triangle, size_t i) {
+    return indexed ? size_t(indices[3*triangle+i]) : 3*triangle+i;
+  };
+  const int64_t triangleChunks = int64_t((triangleCount+clipChunkSize-1)/clipChunkSize);
+  std::vector<uint8_t> outTriangles(triangleCount);
+  std::vector<uint8_t> cutVertices(triangleCount);
+  std::vector<size_t> triangleOffsets(size_t(triangleChunks)+1, 0);
+  std::vector<size_t> cutOffsets(size_t(triangleChunks)+1, 0);
+#pragma omp parallel for
+  for (int64_t c = 0;c<triangleChunks;++c) {
+    const size_t begin = size_t(c)*clipChunkSize;
+    const size_t end = std::min(triangleCount, begin+clipChunkSize);
+    size_t triangles = 0;
+    size_t cuts = 0;
+    for (size_t t = begin;t<end;++t) {
+      uint8_t points = 0;
+      uint8_t crossings = 0;
+      for (size_t i = 0;i<3;++i) {
+        const float da = distances[corner(t, i)];
+        const float db = distances[corner(t, (i+1)%3)];
+        if (da <= 0.0f) points++;
+        if ((da < 0.0f && db > 0.0f) || (da > 0.0f && db < 0.0f)) crossings++;
+      }
+      points += crossings;
+      outTriangles[t] = (points > 2) ? uint8_t(points-2) : 0;
+      cutVertices[t] = crossings;
+      triangles += outTriangles[t];
+      cuts += crossings;
+    }
+    triangleOffsets[size_t(c)+1] = triangles;
+    cutOffsets[size_t(c)+1] = cuts;
+  }
+  for (size_t c = 0;c<size_t(triangleChunks);++c) {
+    triangleOffsets[c+1] += triangleOffsets[c];
+    cutOffsets[c+1] += cutOffsets[c];
+  }
+
+  // the kept vertices are copied as they are, the cut vertices follow
+  Isosurface clipped{true, format};
+  clipped.algorithm = algorithm;
+  clipped.boundsMin = boundsMin;
+  clipped.boundsSize = boundsSize;
+  clipped.resizeVertices(keptCount + cutOffsets[size_t(triangleChunks)]);
+  clipped.indices.resize(3*triangleOffsets[size_t(triangleChunks)]);
+#pragma omp parallel for
+  for (int64_t v = 0;v<int64_t(vertexCount);++v)
+    if (remap[size_t(v)] != noVertex) clipped.copyVertex(*this, size_t(v), remap[size_t(v)]);
+
+  // second pass: whole triangles are renumbered, the others are cut into
+  // a polygon of up to four points and fanned out again, so the winding
+  // is kept; vertices on edges shared by two triangles are created twice
+#pragma omp parallel for
+  for (int64_t c = 0;c<triangleChunks;++c) {
+    const size_t begin = size_t(c)*clipChunkSize;
+    const size_t end = std::min(triangleCount, begin+clipChunkSize);
+    uint32_t* target = clipped.indices.data() + 3*triangleOffsets[size_t(c)];
+    size_t nextCut = keptCount + cutOffsets[size_t(c)];
+    for (size_t t = begin;t<end;++t) {
+      if (outTriangles[t] == 0) continue;
+      if (cutVertices[t] == 0 && outTriangles[t] == 1) {
+        for (size_t i = 0;i<3;++i) *target++ = remap[corner(t, i)];
+        continue;
+      }
+      std::array<uint32_t,4> polygon;
+      size_t points = 0;
+      for (size_t i = 0;i<3;++i) {
+        const size_t a = corner(t, i);
+        const size_t b = corner(t, (i+1)%3);
+        const float da = distances[a];
+        const float db = distances[b];
+        if (da <= 0.0f) polygon[points++] = remap[a];
+        if ((da < 0.0f && db > 0.0f) || (da > 0.0f && db < 0.0f)) {
+          clipped.setVertex(nextCut, cutVertex(getVertex(a), getVertex(b), da, db));
+          polygon[points++] = uint32_t(nextCut++);
+        }
+      }
+      for (size_t i = 2;i<points;++i) {
+        *target++ = polygon[0];
+        *target++ = polygon[i-1];
+        *target++ = polygon[i];
+      }
+    }
+  }
+
+  if (indexed) return clipped;
+  result.resizeVertices(clipped.indices.size());
+#pragma omp parallel for
+  for (int64_t i = 0;i<int64_t(clipped.indices.size());++i)
+    result.copyVertex(clipped, clipped.indices[size_t(i)], size_t(i));
+  return result;
 }
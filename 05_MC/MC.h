@@ -1,14 +1,223 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include "Volume.h"
+#include "StreamingVolume.h"
+#include "MinMaxOctree.h"
+#include "BrickedVolume.h"
 
 struct Vertex {
   Vec3 position;
   Vec3 normal;
 };
 
+enum class IsosurfaceAlgorithm {
+  MarchingCubes,  // per cell, parallel over slabs of cell layers
+  FlyingEdges     // per edge row in four passes, output written once
+};
+
+enum class VertexFormat {
+  Separate,     // Vertex structs in vertices
+  Interleaved,  // floats in interleaved, ready for GLApp's lit triangles
+  Compact       // 12 bytes in compact, ready for GLApp::drawCompactTriangles
+};
+
 struct Isosurface {
-  Isosurface(const Volume& volume, uint8_t isovalue);
+  Isosurface(const Volume& volume, uint8_t isovalue, bool indexed=false,
+             IsosurfaceAlgorithm algorithm=IsosurfaceAlgorithm::MarchingCubes,
+             VertexFormat format=VertexFormat::Separate);
+  // walks the volume slab by slab so it never has to fit into memory
+  Isosurface(StreamingVolume& volume, uint8_t isovalue, bool indexed=false,
+             IsosurfaceAlgorithm algorithm=IsosurfaceAlgorithm::MarchingCubes,
+             VertexFormat format=VertexFormat::Separate);
+  // marching cubes over the active bricks of the octree of volume only
+  Isosurface(const Volume& volume, const MinMaxOctree& octree, uint8_t isovalue,
+             bool indexed=false, VertexFormat format=VertexFormat::Separate);
+  // marching cubes brick by brick over the bricked copy of volume, which
+  // only provides the layout; the cell values and gradients are read
+  // brick-locally and bricks whose range misses the isovalue are skipped
+  Isosurface(const Volume& volume, const BrickedVolume& bricks, uint8_t isovalue,
+             bool indexed=false, VertexFormat format=VertexFormat::Separate);
+
+  // marching cubes for several isovalues in one pass over the volume:
+  // every cell is loaded and its corner gradients looked up once for
+  // all isovalues that cut it; returns one surface per isovalue in the
+  // given order
+  static std::vector<Isosurface> extractAll(const Volume& volume,
+                                            const std::vector<uint8_t>& isovalues,
+                                            bool indexed=false,
+                                            VertexFormat format=VertexFormat::Separate);
+  static std::vector<Isosurface> extractAll(StreamingVolume& volume,
+                                            const std::vector<uint8_t>& isovalues,
+                                            bool indexed=false,
+                                            VertexFormat format=VertexFormat::Separate);
+
+  // walks the volume slab by slab like the streaming constructor, but
+  // hands the surface of every slab to consumer(const Isosurface&) and
+  // drops it afterwards, so the whole mesh never has to fit into
+  // memory; indices are local to the slab surface
+  template <typename F>
+  static void stream(StreamingVolume& volume, uint8_t isovalue, bool indexed,
+                     F consumer);
+  // the same for a volume in memory, usually memory mapped, in slabs of
+  // slabSlices cell layers extracted in place, so the gradients at the
+  // seams see the neighboring slices
+  template <typename F>
+  static void stream(const Volume& volume, uint8_t isovalue, bool indexed,
+                     F consumer, size_t slabSlices=64);
+  // the same for 16 bit data: every slab is squashed into 8 bit over the
+  // value range of the whole volume, as QVis does for all of it at once,
+  // so isovalue refers to the same values without a quantized copy of
+  // the volume
+  template <typename F>
+  static void stream(StreamingVolume16& volume, uint8_t isovalue, bool indexed,
+                     F consumer);
+  template <typename F>
+  static void stream(const Volume16& volume, uint8_t isovalue, bool indexed,
+                     F consumer, size_t slabSlices=64);
+
+  // the part of the surface on the side dot(normal, p) + d <= 0 of the
+  // plane, in the same format and with the same indexing; triangles
+  // that cross the plane are cut along it, the cut itself stays open
+  Isosurface clip(const Vec3& normal, float d) const;
+
+  // a triangle soup, or with indexed output every vertex once, shared
+  // by all triangles that meet at its cell edge, and three indices per
+  // triangle; only vertices on the seams between streamed slabs are
+  // stored twice
   std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  // with VertexFormat::Interleaved the vertices are written straight to
+  // interleavedFloats floats each: position, the position mapped to
+  // [0,1] as rgb with alpha 1 and the normal, which is the layout
+  // GLApp::drawTriangles expects with lighting
+  static const size_t interleavedFloats = 10;
+  std::vector<float> interleaved;
+  // with VertexFormat::Compact every vertex takes compactShorts 16 bit
+  // values: the position quantized over [boundsMin, boundsMin+boundsSize],
+  // padding and the octahedral encoded normal as two signed values
+  static const size_t compactShorts = 6;
+  std::vector<uint16_t> compact;
+  // the extent of the whole volume, centered around the origin
+  Vec3 boundsMin;
+  Vec3 boundsSize;
+
+  size_t getVertexCount() const;
+
+private:
+  friend class LODIsosurface;
+
+  bool indexed;
+  IsosurfaceAlgorithm algorithm;
+  VertexFormat format;
+
+  // an empty surface for extractAll and stream
+  Isosurface(bool indexed, VertexFormat format);
+
+  void setBounds(const Volume& layout, size_t depth);
+  // grow the vertices in the chosen format and set one of them
+  void resizeVertices(size_t count);
+  void setVertex(size_t index, const Vertex& vertex);
+  // decode one of the vertices, whatever the format
+  Vec3 getPosition(size_t index) const;
+  Vertex getVertex(size_t index) const;
+  // copies vertex from of a surface in the same format to vertex to
+  void copyVertex(const Isosurface& source, size_t from, size_t to);
+
+  // extracts the cells between slices z and z+1 of a slab for z in
+  // [cellBegin, cellEnd); the first slice of the slab is slice zOffset
+  // of a volume that is depth slices deep, slices outside the range
+  // only complete the gradients at its ends
+  void extract(const Volume& slab, size_t zOffset, size_t depth,
+               size_t cellBegin, size_t cellEnd, uint8_t isovalue);
+  // the same for the ascending isovalues into the surfaces of the same
+  // index, which all share the same indexing
+  static void extractBatch(const Volume& slab, size_t zOffset, size_t depth,
+                           size_t cellBegin, size_t cellEnd,
+                           const std::vector<uint8_t>& isovalues,
+                           const std::vector<Isosurface*>& surfaces);
+  void extractFlyingEdges(const Volume& slab, size_t zOffset, size_t depth,
+                          size_t cellBegin, size_t cellEnd, uint8_t isovalue);
+  // the range of cell layers of brick layer [zStart, zEnd) within a slab
+  // that starts at slice zFirst of a volume that is depth slices deep,
+  // false if the layer has no cells
+  static bool slabCells(size_t zFirst, size_t zStart, size_t zEnd, size_t depth,
+                        size_t& cellBegin, size_t& cellEnd);
+  // marching cubes over the active bricks of a MinMaxOctree or a
+  // BrickedVolume
+  template <typename Bricks>
+  void extractBricks(const Volume& volume, const Bricks& bricks, uint8_t isovalue);
+  // the surface of the cells of brick layer [zStart, zEnd) in a slab
+  // that starts at slice zFirst, handed to consumer
+  template <typename F>
+  static void streamSlab(const Volume& slab, size_t zFirst, size_t zStart, size_t zEnd,
+                         size_t depth, uint8_t isovalue, bool indexed, F& consumer);
 };
+
+template <typename F>
+void Isosurface::streamSlab(const Volume& slab, size_t zFirst, size_t zStart, size_t zEnd,
+                            size_t depth, uint8_t isovalue, bool indexed, F& consumer) {
+  size_t cellBegin, cellEnd;
+  if (!slabCells(zFirst, zStart, zEnd, depth, cellBegin, cellEnd)) return;
+  Isosurface surface{indexed, VertexFormat::Separate};
+  surface.setBounds(slab, depth);
+  surface.extract(slab, zFirst, depth, cellBegin, cellEnd, isovalue);
+  consumer(surface);
+}
+
+template <typename F>
+void Isosurface::stream(StreamingVolume& volume, uint8_t isovalue, bool indexed,
+                        F consumer) {
+  const size_t depth = volume.getLayout().depth;
+  volume.forEachSlab(1, 2, [&](const Volume& slab, size_t zFirst, size_t zStart, size_t zEnd) {
+    streamSlab(slab, zFirst, zStart, zEnd, depth, isovalue, indexed, consumer);
+  });
+}
+
+template <typename F>
+void Isosurface::stream(const Volume& volume, uint8_t isovalue, bool indexed,
+                        F consumer, size_t slabSlices) {
+  slabSlices = std::max<size_t>(1, slabSlices);
+  for (size_t zStart = 0;zStart+1<volume.depth;zStart += slabSlices) {
+    Isosurface surface{indexed, VertexFormat::Separate};
+    surface.setBounds(volume, volume.depth);
+    surface.extract(volume, 0, volume.depth, zStart,
+                    std::min(volume.depth-1, zStart+slabSlices), isovalue);
+    consumer(surface);
+  }
+}
+
+template <typename F>
+void Isosurface::stream(StreamingVolume16& volume, uint8_t isovalue, bool indexed,
+                        F consumer) {
+  const size_t depth = volume.getLayout().depth;
+  uint16_t minValue, maxValue;
+  volume.getValueRange(minValue, maxValue);
+  volume.forEachSlab(1, 2, [&](const Volume16& slab, size_t zFirst, size_t zStart, size_t zEnd) {
+    streamSlab(quantize16to8(slab, minValue, maxValue), zFirst, zStart, zEnd, depth,
+               isovalue, indexed, consumer);
+  });
+}
+
+template <typename F>
+void Isosurface::stream(const Volume16& volume, uint8_t isovalue, bool indexed,
+                        F consumer, size_t slabSlices) {
+  slabSlices = std::max<size_t>(1, slabSlices);
+  uint16_t minValue, maxValue;
+  valueRange(volume.getData(), volume.getVoxelCount(), minValue, maxValue);
+  const size_t sliceSize = volume.width*volume.height;
+  for (size_t zStart = 0;zStart+1<volume.depth;zStart += slabSlices) {
+    // one more slice on either side for the gradients at the seams
+    const size_t zEnd = std::min(volume.depth, zStart+slabSlices);
+    const size_t zFirst = zStart-std::min<size_t>(zStart, 1);
+    const size_t zLast = std::min(volume.depth, zEnd+2);
+    Volume slab;
+    slab.setLayout(volume);
+    slab.depth = zLast-zFirst;
+    slab.data.resize(slab.getVoxelCount());
+    quantize16to8(volume.getData() + zFirst*sliceSize, slab.data.data(),
+                  slab.data.size(), minValue, maxValue);
+    streamSlab(slab, zFirst, zStart, zEnd, volume.depth, isovalue, indexed, consumer);
+  }
+}
@@ -0,0 +1,214 @@
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "MeshWriter.h"
+
+// counts are written with this many characters, enough for any size_t,
+// so close can overwrite them in place
+static const size_t countWidth = 20;
+
+static std::string paddedCount(size_t count) {
+  std::string text = std::to_string(count);
+  text.resize(countWidth, ' ');
+  return text;
+}
+
+static std::string lowercaseExtension(const std::string& filename) {
+  const size_t dot = filename.find_last_of('.');
+  if (dot == std::string::npos) return "";
+  std::string extension = filename.substr(dot+1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](char c) {return char(std::tolower((unsigned char)c));});
+  return extension;
+}
+
+template <typename T>
+static char* put(char* target, const T& value) {
+  std::memcpy(target, &value, sizeof(T));
+  return target + sizeof(T);
+}
+
+MeshWriter::MeshWriter(const std::string& filename, MeshFileFormat format) :
+  filename{filename},
+  format{format},
+  file{filename, std::ios::binary},
+  vertexCount{0},
+  triangleCount{0}
+{
+  if (!file.is_open())
+    throw MeshWriterException{std::string("unable to create ")+filename};
+  if (format == MeshFileFormat::PLY) {
+    faceFilename = filename + ".faces";
+    faceFile.open(faceFilename, std::ios::binary);
+    if (!faceFile.is_open())
+      throw MeshWriterException{std::string("unable to create ")+faceFilename};
+  }
+  writeHeader();
+}
+
+// a writer that was never closed, usually because the extraction
+// failed, holds an incomplete mesh, so the output is removed rather
+// than finished into a valid looking but truncated file
+MeshWriter::~MeshWriter() {
+  if (file.is_open()) {
+    file.close();
+    std::remove(filename.c_str());
+  }
+  if (faceFile.is_open()) faceFile.close();
+  if (!faceFilename.empty()) std::remove(faceFilename.c_str());
+}
+
+MeshFileFormat MeshWriter::formatOf(const std::string& filename) {
+  const std::string extension = lowercaseExtension(filename);
+  if (extension == "ply") return MeshFileFormat::PLY;
+  if (extension == "stl") return MeshFileFormat::STL;
+  throw MeshWriterException{std::string("unknown mesh format ")+filename};
+}
+
+void MeshWriter::writeHeader() {
+  if (format == MeshFileFormat::PLY) {
+    file << "ply\n"
+         << "format binary_little_endian 1.0\n"
+         << "comment isosurface\n"
+         << "element vertex ";
+    vertexCountPosition = file.tellp();
+    file << paddedCount(0) << "\n"
+         << "property float x\n"
+         << "property float y\n"
+         << "property float z\n"
+         << "property float nx\n"
+         << "property float ny\n"
+         << "property float nz\n"
+         << "element face ";
+    triangleCountPosition = file.tellp();
+    file << paddedCount(0) << "\n"
+         << "property list uchar uint vertex_indices\n"
+         << "end_header\n";
+  } else {
+    // must not start with "solid", which marks ASCII STL
+    char header[80] = "binary STL isosurface";
+    file.write(header, sizeof(header));
+    triangleCountPosition = file.tellp();
+    const uint32_t count = 0;
+    file.write((const char*)&count, sizeof(count));
+  }
+}
+
+void MeshWriter::write(const Isosurface& surface) {
+  if (!file.is_open())
+    throw MeshWriterException{std::string("already closed ")+filename};
+  if (surface.getVertexCount() != surface.vertices.size())
+    throw MeshWriterException{"only VertexFormat::Separate surfaces can be written"};
+  if (format == MeshFileFormat::PLY)
+    writePLY(surface);
+  else
+    writeSTL(surface);
+  if (!file || (faceFile.is_open() && !faceFile))
+    throw MeshWriterException{std::string("unable to write ")+filename};
+}
+
+void MeshWriter::writePLY(const Isosurface& surface) {
+  const std::vector<Vertex>& vertices = surface.vertices;
+  const bool indexed = !surface.indices.empty();
+  const size_t triangles = indexed ? surface.indices.size()/3 : vertices.size()/3;
+  if (vertexCount + vertices.size() > std::numeric_limits<uint32_t>::max())
+    throw MeshWriterException{"too many vertices for 32 bit PLY indices"};
+
+  std::vector<char> buffer(vertices.size()*6*sizeof(float));
+  char* target = buffer.data();
+  for (const Vertex& vertex : vertices) {
+    target = put(target, vertex.position.x);
+    target = put(target, vertex.position.y);
+    target = put(target, vertex.position.z);
+    target = put(target, vertex.normal.x);
+    target = put(target, vertex.normal.y);
+    target = put(target, vertex.normal.z);
+  }
+  file.write(buffer.data(), std::streamsize(buffer.size()));
+
+  // a count byte and three indices per face
+  buffer.resize(triangles*(1+3*sizeof(uint32_t)));
+  target = buffer.data();
+  for (size_t i = 0;i<3*triangles;++i) {
+    if (i%3 == 0) target = put(target, uint8_t(3));
+    target = put(target, uint32_t(vertexCount + (indexed ? surface.indices[i] : i)));
+  }
+  faceFile.write(buffer.data(), std::streamsize(buffer.size()));
+
+  vertexCount += vertices.size();
+  triangleCount += triangles;
+}
+
+void MeshWriter::writeSTL(const Isosurface& surface) {
+  const std::vector<Vertex>& vertices = surface.vertices;
+  const bool indexed = !surface.indices.empty();
+  const size_t triangles = indexed ? surface.indices.size()/3 : vertices.size()/3;
+  if (triangleCount + triangles > std::numeric_limits<uint32_t>::max())
+    throw MeshWriterException{"too many triangles for STL"};
+
+  // facet normal, three positions and an unused attribute per triangle
+  std::vector<char> buffer(triangles*(12*sizeof(float)+sizeof(uint16_t)));
+  char* target = buffer.data();
+  for (size_t t = 0;t<triangles;++t) {
+    const Vec3* corners[3];
+    for (size_t j = 0;j<3;++j)
+      corners[j] = &vertices[indexed ? surface.indices[3*t+j] : 3*t+j].position;
+
+    // the triangles wind counterclockwise around the vertex normals
+    const Vec3 cross = Vec3::cross(*corners[1]-*corners[0], *corners[2]-*corners[0]);
+    const float length = cross.length();
+    const Vec3 normal = (length > 0.0f) ? cross/length : Vec3{0,0,0};
+    target = put(target, normal.x);
+    target = put(target, normal.y);
+    target = put(target, normal.z);
+    for (const Vec3* corner : corners) {
+      target = put(target, corner->x);
+      target = put(target, corner->y);
+      target = put(target, corner->z);
+    }
+    target = put(target, uint16_t(0));
+  }
+  file.write(buffer.data(), std::streamsize(buffer.size()));
+
+  vertexCount += 3*triangles;
+  triangleCount += triangles;
+}
+
+void MeshWriter::appendFaces() {
+  faceFile.close();
+  std::ifstream faces{faceFilename, std::ios::binary};
+  if (!faces.is_open())
+    throw MeshWriterException{std::string("unable to read ")+faceFilename};
+  std::vector<char> buffer(size_t(1)<<20);
+  while (faces) {
+    faces.read(buffer.data(), std::streamsize(buffer.size()));
+    file.write(buffer.data(), faces.gcount());
+  }
+  faces.close();
+  std::remove(faceFilename.c_str());
+}
+
+void MeshWriter::close() {
+  if (!file.is_open()) return;
+  if (format == MeshFileFormat::PLY) {
+    appendFaces();
+    file.seekp(vertexCountPosition);
+    file << paddedCount(vertexCount);
+    file.seekp(triangleCountPosition);
+    file << paddedCount(triangleCount);
+  } else {
+    file.seekp(triangleCountPosition);
+    const uint32_t count = uint32_t(triangleCount);
+    file.write((const char*)&count, sizeof(count));
+  }
+  const bool good = bool(file);
+  file.close();
+  if (!good || file.fail()) {
+    std::remove(filename.c_str());
+    throw MeshWriterException{std::string("unable to write ")+filename};
+  }
+}
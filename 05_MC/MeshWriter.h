@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+
+#include "MC.h"
+
+class MeshWriterException : public std::exception {
+public:
+  MeshWriterException(const std::string& whatStr) : whatStr(whatStr) {}
+  virtual const char* what() const throw() {
+    return whatStr.c_str();
+  }
+private:
+  std::string whatStr;
+};
+
+enum class MeshFileFormat {
+  PLY,  // binary little endian, positions and normals, indexed faces
+  STL   // binary, a facet normal and three positions per triangle
+};
+
+// writes isosurfaces to a binary mesh file piece by piece, so a mesh
+// can be exported while it is extracted without ever being complete in
+// memory; the header is written with room for the counts, which close
+// fills in once they are known. PLY stores all vertices before the
+// faces, so the faces go to a temporary file next to the output first
+// and are appended on close. Only close produces a valid file, a writer
+// destroyed without it, e.g. because the extraction threw, removes its
+// output
+class MeshWriter {
+public:
+  MeshWriter(const std::string& filename, MeshFileFormat format);
+  ~MeshWriter();
+
+  MeshWriter(const MeshWriter& other) = delete;
+  MeshWriter& operator=(const MeshWriter& other) = delete;
+
+  // the format that belongs to the extension of filename
+  static MeshFileFormat formatOf(const std::string& filename);
+
+  // appends the triangles of surface, which has to use
+  // VertexFormat::Separate, soup or indexed
+  void write(const Isosurface& surface);
+  // completes the file, on failure it is removed and an exception thrown
+  void close();
+
+  size_t getVertexCount() const {return vertexCount;}
+  size_t getTriangleCount() const {return triangleCount;}
+
+private:
+  std::string filename;
+  std::string faceFilename;
+  MeshFileFormat format;
+  std::ofstream file;
+  std::ofstream faceFile;
+  std::streampos vertexCountPosition;
+  std::streampos triangleCountPosition;
+  size_t vertexCount;
+  size_t triangleCount;
+
+  void writeHeader();
+  void writePLY(const Isosurface& surface);
+  void writeSTL(const Isosurface& surface);
+  void appendFaces();
+};
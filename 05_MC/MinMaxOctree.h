@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "Volume.h"
+
+// span space index of a volume: an octree of min/max values over bricks
+// of brickSize^3 cells; a brick covers the voxels of its cells including
+// their upper faces, so it contains part of an isosurface exactly if its
+// range straddles the isovalue; built once per volume, queries descend
+// only into nodes that straddle the isovalue, so their cost follows the
+// size of the isosurface rather than that of the volume
+class MinMaxOctree {
+public:
+  MinMaxOctree() :
+    brickSize{0},
+    bricksX{0}, bricksY{0}, bricksZ{0}
+  {}
+
+  MinMaxOctree(const Volume& volume, size_t brickSize=8) :
+    brickSize{brickSize},
+    bricksX{bricksAlong(volume.width, brickSize)},
+    bricksY{bricksAlong(volume.height, brickSize)},
+    bricksZ{bricksAlong(volume.depth, brickSize)}
+  {
+    if (getBrickCount() == 0) return;
+
+    Level bricks{bricksX, bricksY, bricksZ, {}, {}};
+    bricks.minValues.resize(getBrickCount());
+    bricks.maxValues.resize(getBrickCount());
+
+    const uint8_t* voxels = volume.getData();
+    const size_t sliceSize = volume.width*volume.height;
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t bz = 0;bz<int64_t(bricksZ);++bz) {
+      const size_t z0 = size_t(bz)*brickSize;
+      const size_t z1 = std::min(z0+brickSize+1, volume.depth);
+      for (size_t by = 0;by<bricksY;++by) {
+        const size_t y0 = by*brickSize;
+        const size_t y1 = std::min(y0+brickSize+1, volume.height);
+        for (size_t bx = 0;bx<bricksX;++bx) {
+          const size_t x0 = bx*brickSize;
+          const size_t x1 = std::min(x0+brickSize+1, volume.width);
+          uint8_t minVal = voxels[x0 + y0*volume.width + z0*sliceSize];
+          uint8_t maxVal = minVal;
+          for (size_t z = z0;z<z1;++z) {
+            for (size_t y = y0;y<y1;++y) {
+              const uint8_t* row = voxels + y*volume.width + z*sliceSize;
+              for (size_t x = x0;x<x1;++x) {
+                minVal = std::min(minVal, row[x]);
+                maxVal = std::max(maxVal, row[x]);
+              }
+            }
+          }
+          const size_t index = bx + by*bricksX + size_t(bz)*bricksX*bricksY;
+          bricks.minValues[index] = minVal;
+          bricks.maxValues[index] = maxVal;
+        }
+      }
+    }
+    levels.push_back(bricks);
+
+    // every coarser level halves the resolution until a single root
+    // node covers the whole volume
+    while (levels.back().x > 1 || levels.back().y > 1 || levels.back().z > 1) {
+      const Level& fine = levels.back();
+      Level coarse{(fine.x+1)/2, (fine.y+1)/2, (fine.z+1)/2, {}, {}};
+      coarse.minValues.resize(coarse.x*coarse.y*coarse.z, 255);
+      coarse.maxValues.resize(coarse.x*coarse.y*coarse.z, 0);
+      for (size_t z = 0;z<fine.z;++z) {
+        for (size_t y = 0;y<fine.y;++y) {
+          for (size_t x = 0;x<fine.x;++x) {
+            const size_t source = x + y*fine.x + z*fine.x*fine.y;
+            const size_t target = x/2 + (y/2)*coarse.x + (z/2)*coarse.x*coarse.y;
+            coarse.minValues[target] = std::min(coarse.minValues[target], fine.minValues[source]);
+            coarse.maxValues[target] = std::max(coarse.maxValues[target], fine.maxValues[source]);
+          }
+        }
+      }
+      levels.push_back(coarse);
+    }
+  }
+
+  size_t brickSize;
+  size_t bricksX;
+  size_t bricksY;
+  size_t bricksZ;
+
+  size_t getBrickCount() const {
+    return bricksX*bricksY*bricksZ;
+  }
+
+  // the brick that owns voxel (x, y, z), i.e. the one in which the voxel
+  // is not on an upper face unless it lies on the upper face of the volume
+  size_t getBrickIndex(size_t x, size_t y, size_t z) const {
+    return std::min(x/brickSize, bricksX-1) +
+           std::min(y/brickSize, bricksY-1)*bricksX +
+           std::min(z/brickSize, bricksZ-1)*bricksX*bricksY;
+  }
+
+  // the bricks that contain cells with corners below and at or above
+  // the isovalue, in ascending order of their index
+  std::vector<uint32_t> activeBricks(uint8_t isovalue) const {
+    std::vector<uint32_t> bricks;
+    if (levels.empty()) return bricks;
+
+    // (level, node) pairs still to visit
+    std::vector<std::pair<size_t,size_t>> stack{{levels.size()-1, 0}};
+    while (!stack.empty()) {
+      const size_t l = stack.back().first;
+      const size_t node = stack.back().second;
+      stack.pop_back();
+
+      const Level& level = levels[l];
+      if (level.minValues[node] >= isovalue || level.maxValues[node] < isovalue) continue;
+      if (l == 0) {
+        bricks.push_back(uint32_t(node));
+        continue;
+      }
+
+      const Level& fine = levels[l-1];
+      const size_t x = node % level.x;
+      const size_t y = (node / level.x) % level.y;
+      const size_t z = node / (level.x*level.y);
+      for (size_t dz = 0;dz<2;++dz) {
+        for (size_t dy = 0;dy<2;++dy) {
+          for (size_t dx = 0;dx<2;++dx) {
+            const size_t fx = 2*x+dx, fy = 2*y+dy, fz = 2*z+dz;
+            if (fx < fine.x && fy < fine.y && fz < fine.z)
+              stack.push_back(std::make_pair(l-1, fx + fy*fine.x + fz*fine.x*fine.y));
+          }
+        }
+      }
+    }
+    std::sort(bricks.begin(), bricks.end());
+    return bricks;
+  }
+
+private:
+  struct Level {
+    size_t x, y, z;
+    std::vector<uint8_t> minValues;
+    std::vector<uint8_t> maxValues;
+  };
+  // levels[0] are the bricks, the last level is the root
+  std::vector<Level> levels;
+
+  static size_t bricksAlong(size_t voxels, size_t brickSize) {
+    return (voxels < 2) ? 0 : (voxels-1+brickSize-1)/brickSize;
+  }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Volume.h"
+#include "VolumeContainer.h"
 
 class QVisFileException : std::exception {
 public:
@@ -26,11 +27,32 @@ private:
 
 class QVis {
 public:
-  QVis(const std::string& filename);
-  void load(const std::string& filename);
-  
+  QVis(const std::string& filename, bool memoryMapped=false,
+       bool keep16Bit=false);
+  void load(const std::string& filename, bool memoryMapped=false,
+            bool keep16Bit=false);
+
+  bool is16Bit() const {return volume16.getVoxelCount() > 0;}
+
+  // writes the loaded volume as a compressed, bricked container which
+  // load accepts in place of a .dat file
+  void save(const std::string& filename, size_t brickSize=32,
+            bool withNormals=false) const;
+
+  // fills pyramid (or pyramid16) with box filtered copies of half,
+  // quarter, ... the resolution of the loaded volume
+  void buildPyramid(size_t minSize=1);
+
+  // 8bit data, or 16bit data squashed into 8bit unless keep16Bit is set
   Volume volume;
+  // native 16bit data, only filled if keep16Bit is set
+  Volume16 volume16;
+  // coarser levels of the volume, only filled by buildPyramid
+  std::vector<Volume> pyramid;
+  std::vector<Volume16> pyramid16;
   
 private:
+  void loadContainer(const std::string& filename, bool keep16Bit);
+  void loadNative16Bit(const std::string& rawFilename, bool memoryMapped);
   std::vector<std::string> tokenize(const std::string& str) const;
 };
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <future>
+#include <limits>
+#include <unordered_map>
+
+#include "Volume.h"
+#include "VolumeContainer.h"
+
+// out-of-core access to a volume container: bricks are decoded on
+// demand and kept in an LRU cache bounded by a byte budget, so data
+// sets larger than main memory can be processed slab by slab; while
+// one slab is processed the bricks of the next one are prefetched
+template <typename T>
+class StreamingVolumeT {
+public:
+  typedef std::shared_ptr<const std::vector<T>> Brick;
+
+  StreamingVolumeT(const std::string& filename,
+                   size_t cacheBudget=size_t(256)*1024*1024) :
+    container{filename},
+    cacheBudget{cacheBudget},
+    cacheSize{0},
+    hits{0},
+    misses{0}
+  {
+    if (container.bytesPerVoxel != sizeof(T))
+      throw VolumeContainerException{std::string("voxel size mismatch ")+filename};
+    // a full brick has to fit, otherwise every insert overshoots the budget
+    const size_t brickBytes = container.brickSize*container.brickSize*
+                              container.brickSize*sizeof(T);
+    if (cacheBudget < brickBytes)
+      throw VolumeContainerException{std::string("cache budget below one brick of ")+
+                                     std::to_string(brickBytes)+" bytes"};
+    layout.width = container.width;
+    layout.height = container.height;
+    layout.depth = container.depth;
+    layout.scale = container.scale;
+    layout.normalizeScale();
+  }
+
+  // only waits, an error of the prefetch must not escape the destructor
+  ~StreamingVolumeT() {
+    if (prefetchTask.valid()) prefetchTask.wait();
+  }
+
+  StreamingVolumeT(const StreamingVolumeT& other) = delete;
+  StreamingVolumeT& operator=(const StreamingVolumeT& other) = delete;
+
+  // dimensions and scale, without any voxel data
+  const VolumeT<T>& getLayout() const {return layout;}
+  size_t getBrickSize() const {return container.brickSize;}
+  // the range of all voxel values, from the brick table of the container
+  // so no brick has to be decoded
+  void getValueRange(T& minValue, T& maxValue) const {
+    minValue = maxValue = 0;
+    for (size_t i = 0;i<container.getBrickCount();++i) {
+      const VolumeContainer::BrickEntry& brick = container.getBrick(i);
+      minValue = (i == 0) ? T(brick.minValue) : std::min(minValue, T(brick.minValue));
+      maxValue = (i == 0) ? T(brick.maxValue) : std::max(maxValue, T(brick.maxValue));
+    }
+  }
+  // the prefetch task updates these, hence the lock
+  size_t getCacheSize() const {
+    std::lock_guard<std::mutex> lock{cacheMutex};
+    return cacheSize;
+  }
+  size_t getCacheHits() const {
+    std::lock_guard<std::mutex> lock{cacheMutex};
+    return hits;
+  }
+  size_t getCacheMisses() const {
+    std::lock_guard<std::mutex> lock{cacheMutex};
+    return misses;
+  }
+
+  // thread safe, the returned brick stays valid even if it is evicted
+  Brick getBrick(size_t index) {
+    {
+      std::lock_guard<std::mutex> lock{cacheMutex};
+      auto entry = cache.find(index);
+      if (entry != cache.end()) {
+        lru.splice(lru.begin(), lru, entry->second.second);
+        ++hits;
+        return entry->second.first;
+      }
+      ++misses;
+    }
+
+    // decode outside the lock so several bricks load in parallel
+    size_t ex, ey, ez;
+    container.getBrickExtent(index, ex, ey, ez);
+    std::shared_ptr<std::vector<T>> brick = std::make_shared<std::vector<T>>(ex*ey*ez);
+    container.readBrick(index, brick->data());
+
+    std::lock_guard<std::mutex> lock{cacheMutex};
+    auto entry = cache.find(index);
+    if (entry != cache.end()) return entry->second.first;
+
+    const size_t bytes = brick->size()*sizeof(T);
+    while (!lru.empty() && cacheSize + bytes > cacheBudget) {
+      auto victim = cache.find(lru.back());
+      cacheSize -= victim->second.first->size()*sizeof(T);
+      cache.erase(victim);
+      lru.pop_back();
+    }
+    lru.push_front(index);
+    cache[index] = std::make_pair(Brick{brick}, lru.begin());
+    cacheSize += bytes;
+    return brick;
+  }
+
+  // starts decoding the bricks covering slices [zStart, zEnd) in the
+  // background, only one prefetch is in flight at any time
+  void prefetchSlices(size_t zStart, size_t zEnd) {
+    waitForPrefetch();
+    if (zStart >= zEnd) return;
+    prefetchTask = std::async(std::launch::async, [this, zStart, zEnd]() {
+      for (size_t b : bricksInSlices(zStart, zEnd)) getBrick(b);
+    });
+  }
+
+  // assembles slices [zStart, zEnd) into a flat volume that keeps the
+  // scale of the whole data set
+  VolumeT<T> readSlab(size_t zStart, size_t zEnd) {
+    VolumeT<T> slab;
+    slab.setLayout(layout);
+    slab.depth = zEnd-zStart;
+    slab.data.resize(slab.getVoxelCount());
+
+    const std::vector<size_t> bricks = bricksInSlices(zStart, zEnd);
+    const size_t sliceSize = layout.width*layout.height;
+    // an exception must not leave the parallel region, so the first error
+    // is kept, the remaining bricks are skipped and it is thrown afterwards
+    std::string error;
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t i = 0;i<int64_t(bricks.size());++i) {
+      const size_t b = bricks[size_t(i)];
+      size_t ox, oy, oz, ex, ey, ez;
+      container.getBrickOrigin(b, ox, oy, oz);
+      container.getBrickExtent(b, ex, ey, ez);
+      const Brick brick = getBrickOrRecord(b, error);
+      if (!brick) continue;
+
+      const size_t first = std::max(oz, zStart);
+      const size_t last = std::min(oz+ez, zEnd);
+      for (size_t z = first;z<last;++z) {
+        for (size_t y = 0;y<ey;++y) {
+          const T* source = brick->data() + y*ex + (z-oz)*ex*ey;
+          T* target = slab.data.data() + ox + (oy+y)*layout.width + (z-zStart)*sliceSize;
+          std::copy(source, source+ex, target);
+        }
+      }
+    }
+    if (!error.empty()) throw VolumeContainerException{error};
+    return slab;
+  }
+
+  // calls callback(slab, zFirst, zStart, zEnd) for the consecutive brick
+  // layers [zStart, zEnd); the slab extends the layer by up to before
+  // slices in front of it and after slices behind it, within the volume,
+  // and starts at slice zFirst
+  template <typename F>
+  void forEachSlab(size_t before, size_t after, F callback) {
+    const size_t brickSize = container.brickSize;
+    for (size_t zStart = 0;zStart<layout.depth;zStart += brickSize) {
+      const size_t zEnd = std::min(layout.depth, zStart+brickSize);
+      const size_t zFirst = zStart-std::min(zStart, before);
+      const size_t zLast = std::min(layout.depth, zEnd+after);
+      const VolumeT<T> slab = readSlab(zFirst, zLast);
+      prefetchSlices(zLast, std::min(layout.depth, zEnd+brickSize+after));
+      callback(slab, zFirst, zStart, zEnd);
+    }
+    waitForPrefetch();
+  }
+
+  // same result as VolumeT::resample, computed from slabs that cover
+  // about one brick layer of the source each
+  VolumeT<T> resample(size_t targetWidth, size_t targetHeight, size_t targetDepth,
+                      ResampleFilter filter=ResampleFilter::Trilinear) {
+    VolumeT<T> result = layout.createResampleTarget(targetWidth, targetHeight, targetDepth);
+    if (result.data.empty()) return result;
+
+    const size_t chunk = std::max<size_t>(1, result.depth*container.brickSize/layout.depth);
+    for (size_t targetStart = 0;targetStart<result.depth;targetStart += chunk) {
+      const size_t targetEnd = std::min(result.depth, targetStart+chunk);
+      size_t begin, end;
+      VolumeT<T>::sourceRange(layout.depth, result.depth, targetStart, targetEnd,
+                              filter, begin, end);
+      const VolumeT<T> slab = readSlab(begin, end);
+
+      if (targetEnd < result.depth) {
+        size_t nextBegin, nextEnd;
+        VolumeT<T>::sourceRange(layout.depth, result.depth, targetEnd,
+                                std::min(result.depth, targetEnd+chunk),
+                                filter, nextBegin, nextEnd);
+        prefetchSlices(std::max(nextBegin, end), nextEnd);
+      }
+      slab.resampleSlices(result, layout.depth, begin, targetStart, targetEnd, filter);
+    }
+    waitForPrefetch();
+    return result;
+  }
+
+  // value histogram with binCount equally wide bins over the range of T
+  std::vector<uint64_t> computeHistogram(size_t binCount=256) {
+    std::vector<uint64_t> histogram(binCount, 0);
+    const uint64_t valueCount = uint64_t(std::numeric_limits<T>::max())+1;
+    const size_t brickSize = container.brickSize;
+
+    for (size_t zStart = 0;zStart<layout.depth;zStart += brickSize) {
+      const size_t zEnd = std::min(layout.depth, zStart+brickSize);
+      prefetchSlices(zEnd, std::min(layout.depth, zEnd+brickSize));
+      const std::vector<size_t> bricks = bricksInSlices(zStart, zEnd);
+      // thrown after the region like in readSlab
+      std::string error;
+#pragma omp parallel
+      {
+        std::vector<uint64_t> local(binCount, 0);
+#pragma omp for schedule(dynamic)
+        for (int64_t i = 0;i<int64_t(bricks.size());++i) {
+          const Brick brick = getBrickOrRecord(bricks[size_t(i)], error);
+          if (!brick) continue;
+          for (const T value : *brick)
+            ++local[size_t(uint64_t(value)*binCount/valueCount)];
+        }
+#pragma omp critical
+        for (size_t j = 0;j<binCount;++j) histogram[j] += local[j];
+      }
+      if (!error.empty()) throw VolumeContainerException{error};
+    }
+    waitForPrefetch();
+    return histogram;
+  }
+
+private:
+  VolumeContainer container;
+  VolumeT<T> layout;
+
+  size_t cacheBudget;
+  size_t cacheSize;
+  size_t hits;
+  size_t misses;
+  std::list<size_t> lru;
+  std::unordered_map<size_t, std::pair<Brick, std::list<size_t>::iterator>> cache;
+  mutable std::mutex cacheMutex;
+  std::future<void> prefetchTask;
+
+  std::vector<size_t> bricksInSlices(size_t zStart, size_t zEnd) const {
+    std::vector<size_t> bricks;
+    if (zStart >= zEnd) return bricks;
+    const size_t brickSize = container.brickSize;
+    const size_t bricksX = (layout.width+brickSize-1)/brickSize;
+    const size_t bricksY = (layout.height+brickSize-1)/brickSize;
+    for (size_t bz = zStart/brickSize;bz<=(zEnd-1)/brickSize;++bz)
+      for (size_t by = 0;by<bricksY;++by)
+        for (size_t bx = 0;bx<bricksX;++bx)
+          bricks.push_back(container.getBrickIndex(bx, by, bz));
+    return bricks;
+  }
+
+  void waitForPrefetch() {
+    if (prefetchTask.valid()) prefetchTask.get();
+  }
+
+  // getBrick for the parallel loops: null once error is set, and on
+  // failure the first error message is stored in error instead of thrown
+  Brick getBrickOrRecord(size_t index, std::string& error) {
+    bool failed;
+#pragma omp critical(brickError)
+    failed = !error.empty();
+    if (failed) return Brick{};
+    try {
+      return getBrick(index);
+    } catch (const VolumeContainerException& e) {
+#pragma omp critical(brickError)
+      if (error.empty()) error = e.what();
+      return Brick{};
+    }
+  }
+};
+
+typedef StreamingVolumeT<uint8_t> StreamingVolume;
+typedef StreamingVolumeT<uint16_t> StreamingVolume16;
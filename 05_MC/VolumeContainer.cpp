@@ -0,0 +1,358 @@
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#include <LZ.h>
+
+#include "VolumeContainer.h"
+
+static const char magic[4] = {'Q','V','B','1'};
+static const uint32_t version = 1;
+static const uint32_t normalsFlag = 1;
+static const size_t headerSize = 4 + 4*4 + 8*3 + 4*3;
+static const size_t entrySize = 8*4 + 4*2;
+
+template <typename T>
+static void writeValue(std::ostream& stream, const T& value) {
+  stream.write((const char*)&value, sizeof(T));
+}
+
+template <typename T>
+static T readValue(const uint8_t*& p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return value;
+}
+
+// copies one brick into a contiguous buffer, replacing every voxel by
+// its difference to the previous one in the row, and reports its range
+template <typename T>
+static void gatherBrick(const T* voxels, size_t width, size_t height,
+                        size_t ox, size_t oy, size_t oz,
+                        size_t ex, size_t ey, size_t ez,
+                        T* target, uint32_t& minValue, uint32_t& maxValue) {
+  T minVal = voxels[ox + oy*width + oz*width*height];
+  T maxVal = minVal;
+  for (size_t z = 0;z<ez;++z) {
+    for (size_t y = 0;y<ey;++y) {
+      const T* row = voxels + ox + (oy+y)*width + (oz+z)*width*height;
+      T previous = 0;
+      for (size_t x = 0;x<ex;++x) {
+        minVal = std::min(minVal, row[x]);
+        maxVal = std::max(maxVal, row[x]);
+        *target++ = T(row[x] - previous);
+        previous = row[x];
+      }
+    }
+  }
+  minValue = minVal;
+  maxValue = maxVal;
+}
+
+template <typename T>
+static void undoDelta(T* data, size_t rowLength, size_t rowCount) {
+  for (size_t r = 0;r<rowCount;++r) {
+    T* row = data + r*rowLength;
+    for (size_t x = 1;x<rowLength;++x)
+      row[x] = T(row[x] + row[x-1]);
+  }
+}
+
+// groups the n-th bytes of all elements, so the mostly constant high
+// bytes of 16bit values end up in long runs
+static void shuffleBytes(const uint8_t* source, uint8_t* target,
+                         size_t count, size_t elementSize) {
+  for (size_t k = 0;k<elementSize;++k)
+    for (size_t i = 0;i<count;++i)
+      target[k*count+i] = source[i*elementSize+k];
+}
+
+static void unshuffleBytes(const uint8_t* source, uint8_t* target,
+                           size_t count, size_t elementSize) {
+  for (size_t k = 0;k<elementSize;++k)
+    for (size_t i = 0;i<count;++i)
+      target[i*elementSize+k] = source[k*count+i];
+}
+
+// payloads that do not shrink are stored as they are, which the
+// reader recognizes by the payload size equaling the raw size
+static std::vector<uint8_t> pack(const uint8_t* data, size_t size,
+                                 size_t elementSize) {
+  std::vector<uint8_t> shuffled(size);
+  shuffleBytes(data, shuffled.data(), size/elementSize, elementSize);
+  std::vector<uint8_t> compressed = LZ::compress(shuffled.data(), size);
+  if (compressed.size() >= size) return shuffled;
+  return compressed;
+}
+
+VolumeContainer::VolumeContainer(const std::string& filename) :
+  width{0}, height{0}, depth{0},
+  scale{0.0f, 0.0f, 0.0f},
+  bytesPerVoxel{0}, brickSize{0}, hasNormals{false},
+  bricksX{0}, bricksY{0}, bricksZ{0}
+{
+  try {
+    file = std::make_shared<MappedFile>(filename);
+  } catch (const MappedFileException& e) {
+    throw VolumeContainerException{e.what()};
+  }
+
+  if (file->getSize() < headerSize ||
+      memcmp(file->getData(), magic, sizeof(magic)) != 0)
+    throw VolumeContainerException{std::string("not a volume container ")+filename};
+
+  const uint8_t* p = file->getData() + sizeof(magic);
+  if (readValue<uint32_t>(p) != version)
+    throw VolumeContainerException{std::string("unsupported container version ")+filename};
+  bytesPerVoxel = readValue<uint32_t>(p);
+  brickSize = readValue<uint32_t>(p);
+  hasNormals = (readValue<uint32_t>(p) & normalsFlag) != 0;
+  width = size_t(readValue<uint64_t>(p));
+  height = size_t(readValue<uint64_t>(p));
+  depth = size_t(readValue<uint64_t>(p));
+  scale.x = readValue<float>(p);
+  scale.y = readValue<float>(p);
+  scale.z = readValue<float>(p);
+
+  if ((bytesPerVoxel != 1 && bytesPerVoxel != 2) || brickSize == 0)
+    throw VolumeContainerException{std::string("corrupt container header ")+filename};
+
+  bricksX = (width+brickSize-1)/brickSize;
+  bricksY = (height+brickSize-1)/brickSize;
+  bricksZ = (depth+brickSize-1)/brickSize;
+  const size_t brickCount = bricksX*bricksY*bricksZ;
+  if (file->getSize() < headerSize + brickCount*entrySize)
+    throw VolumeContainerException{std::string("truncated brick table ")+filename};
+
+  bricks.resize(brickCount);
+  for (BrickEntry& b : bricks) {
+    b.offset = readValue<uint64_t>(p);
+    b.size = readValue<uint64_t>(p);
+    b.normalOffset = readValue<uint64_t>(p);
+    b.normalSize = readValue<uint64_t>(p);
+    b.minValue = readValue<uint32_t>(p);
+    b.maxValue = readValue<uint32_t>(p);
+    if (b.size > file->getSize() || b.offset > file->getSize() - b.size ||
+        b.normalSize > file->getSize() || b.normalOffset > file->getSize() - b.normalSize)
+      throw VolumeContainerException{std::string("brick out of bounds ")+filename};
+  }
+}
+
+bool VolumeContainer::isContainer(const std::string& filename) {
+  std::ifstream stream(filename, std::ios::binary);
+  char header[sizeof(magic)];
+  if (!stream.read(header, sizeof(header))) return false;
+  return memcmp(header, magic, sizeof(magic)) == 0;
+}
+
+size_t VolumeContainer::getBrickIndex(size_t bx, size_t by, size_t bz) const {
+  return bx + by*bricksX + bz*bricksX*bricksY;
+}
+
+void VolumeContainer::getBrickOrigin(size_t index, size_t& x, size_t& y, size_t& z) const {
+  x = (index % bricksX) * brickSize;
+  y = ((index / bricksX) % bricksY) * brickSize;
+  z = (index / (bricksX*bricksY)) * brickSize;
+}
+
+void VolumeContainer::getBrickExtent(size_t index, size_t& x, size_t& y, size_t& z) const {
+  size_t ox, oy, oz;
+  getBrickOrigin(index, ox, oy, oz);
+  x = std::min(brickSize, width-ox);
+  y = std::min(brickSize, height-oy);
+  z = std::min(brickSize, depth-oz);
+}
+
+void VolumeContainer::decode(uint64_t offset, uint64_t size, uint8_t* target,
+                             size_t targetSize) const {
+  const uint8_t* source = file->getData() + offset;
+  if (size == targetSize) {
+    memcpy(target, source, targetSize);
+    return;
+  }
+  try {
+    LZ::decompress(source, size_t(size), target, targetSize);
+  } catch (const LZException& e) {
+    throw VolumeContainerException{std::string("corrupt brick: ")+e.what()};
+  }
+}
+
+void VolumeContainer::readBrick(size_t index, void* target) const {
+  std::vector<uint8_t> shuffled;
+  readBrick(index, target, shuffled);
+}
+
+void VolumeContainer::readBrick(size_t index, void* target,
+                                std::vector<uint8_t>& shuffled) const {
+  size_t ex, ey, ez;
+  getBrickExtent(index, ex, ey, ez);
+  const size_t count = ex*ey*ez;
+  const size_t byteCount = count*bytesPerVoxel;
+
+  // single bytes are not shuffled, so they are decoded in place
+  if (bytesPerVoxel == 1) {
+    decode(bricks[index].offset, bricks[index].size, (uint8_t*)target, byteCount);
+    undoDelta((uint8_t*)target, ex, ey*ez);
+    return;
+  }
+  shuffled.resize(byteCount);
+  decode(bricks[index].offset, bricks[index].size, shuffled.data(), byteCount);
+  unshuffleBytes(shuffled.data(), (uint8_t*)target, count, bytesPerVoxel);
+  undoDelta((uint16_t*)target, ex, ey*ez);
+}
+
+void VolumeContainer::readBrickNormals(size_t index, uint16_t* target) const {
+  std::vector<uint8_t> shuffled;
+  readBrickNormals(index, target, shuffled);
+}
+
+void VolumeContainer::readBrickNormals(size_t index, uint16_t* target,
+                                       std::vector<uint8_t>& shuffled) const {
+  if (!hasNormals) throw VolumeContainerException("container has no normals");
+  size_t ex, ey, ez;
+  getBrickExtent(index, ex, ey, ez);
+  const size_t count = ex*ey*ez;
+
+  shuffled.resize(count*2);
+  decode(bricks[index].normalOffset, bricks[index].normalSize,
+         shuffled.data(), count*2);
+  unshuffleBytes(shuffled.data(), (uint8_t*)target, count, 2);
+}
+
+void VolumeContainer::readVolume(uint8_t* voxels, uint16_t* normals) const {
+  const size_t brickVoxels = brickSize*brickSize*brickSize;
+  // an exception must not leave the parallel region, so the first error
+  // is kept, the remaining bricks are skipped and it is thrown afterwards
+  std::string error;
+#pragma omp parallel
+  {
+    // the buffers of a thread, reused for all of its bricks
+    std::vector<uint8_t> brick(brickVoxels*bytesPerVoxel);
+    std::vector<uint16_t> brickNormals(normals ? brickVoxels : 0);
+    std::vector<uint8_t> shuffled;
+#pragma omp for schedule(dynamic)
+    for (int64_t b = 0;b<int64_t(bricks.size());++b) {
+      bool failed;
+#pragma omp critical(readVolumeError)
+      failed = !error.empty();
+      if (failed) continue;
+
+      size_t ox, oy, oz, ex, ey, ez;
+      getBrickOrigin(size_t(b), ox, oy, oz);
+      getBrickExtent(size_t(b), ex, ey, ez);
+      try {
+        readBrick(size_t(b), brick.data(), shuffled);
+        if (normals) readBrickNormals(size_t(b), brickNormals.data(), shuffled);
+      } catch (const VolumeContainerException& e) {
+#pragma omp critical(readVolumeError)
+        if (error.empty()) error = e.what();
+        continue;
+      }
+
+      for (size_t z = 0;z<ez;++z) {
+        for (size_t y = 0;y<ey;++y) {
+          const size_t source = y*ex + z*ex*ey;
+          const size_t target = ox + (oy+y)*width + (oz+z)*width*height;
+          memcpy(voxels + target*bytesPerVoxel, brick.data() + source*bytesPerVoxel,
+                 ex*bytesPerVoxel);
+          if (normals)
+            memcpy(normals + target, brickNormals.data() + source, ex*2);
+        }
+      }
+    }
+  }
+  if (!error.empty()) throw VolumeContainerException{error};
+}
+
+void VolumeContainer::write(const std::string& filename, const uint8_t* voxels,
+                            size_t bytesPerVoxel, size_t width, size_t height,
+                            size_t depth, const Vec3& scale, size_t brickSize,
+                            const uint16_t* normals) {
+  if (bytesPerVoxel != 1 && bytesPerVoxel != 2)
+    throw VolumeContainerException("only 8 and 16 bit volumes are supported");
+  if (brickSize == 0)
+    throw VolumeContainerException("invalid brick size");
+
+  const size_t bricksX = (width+brickSize-1)/brickSize;
+  const size_t bricksY = (height+brickSize-1)/brickSize;
+  const size_t bricksZ = (depth+brickSize-1)/brickSize;
+  const size_t brickCount = bricksX*bricksY*bricksZ;
+
+  std::vector<BrickEntry> entries(brickCount);
+  std::vector<std::vector<uint8_t>> payloads(brickCount);
+  std::vector<std::vector<uint8_t>> normalPayloads(brickCount);
+
+  // compress all bricks in parallel, the file is written in order below
+#pragma omp parallel
+  {
+    std::vector<uint8_t> brick(brickSize*brickSize*brickSize*bytesPerVoxel);
+    std::vector<uint16_t> brickNormals(normals ? brickSize*brickSize*brickSize : 0);
+#pragma omp for schedule(dynamic)
+    for (int64_t b = 0;b<int64_t(brickCount);++b) {
+      const size_t ox = (size_t(b) % bricksX) * brickSize;
+      const size_t oy = ((size_t(b) / bricksX) % bricksY) * brickSize;
+      const size_t oz = (size_t(b) / (bricksX*bricksY)) * brickSize;
+      const size_t ex = std::min(brickSize, width-ox);
+      const size_t ey = std::min(brickSize, height-oy);
+      const size_t ez = std::min(brickSize, depth-oz);
+      const size_t count = ex*ey*ez;
+
+      BrickEntry& entry = entries[size_t(b)];
+      if (bytesPerVoxel == 1)
+        gatherBrick(voxels, width, height, ox, oy, oz, ex, ey, ez,
+                    brick.data(), entry.minValue, entry.maxValue);
+      else
+        gatherBrick((const uint16_t*)voxels, width, height, ox, oy, oz, ex, ey, ez,
+                    (uint16_t*)brick.data(), entry.minValue, entry.maxValue);
+      payloads[size_t(b)] = pack(brick.data(), count*bytesPerVoxel, bytesPerVoxel);
+
+      if (normals) {
+        size_t i = 0;
+        for (size_t z = 0;z<ez;++z)
+          for (size_t y = 0;y<ey;++y)
+            for (size_t x = 0;x<ex;++x)
+              brickNormals[i++] = normals[ox+x + (oy+y)*width + (oz+z)*width*height];
+        normalPayloads[size_t(b)] = pack((const uint8_t*)brickNormals.data(), count*2, 2);
+      }
+    }
+  }
+
+  uint64_t offset = headerSize + brickCount*entrySize;
+  for (size_t b = 0;b<brickCount;++b) {
+    entries[b].offset = offset;
+    entries[b].size = payloads[b].size();
+    offset += entries[b].size;
+    entries[b].normalOffset = offset;
+    entries[b].normalSize = normalPayloads[b].size();
+    offset += entries[b].normalSize;
+  }
+
+  std::ofstream stream(filename, std::ios::binary);
+  if (!stream) throw VolumeContainerException{std::string("Unable to write file ")+filename};
+
+  stream.write(magic, sizeof(magic));
+  writeValue(stream, version);
+  writeValue(stream, uint32_t(bytesPerVoxel));
+  writeValue(stream, uint32_t(brickSize));
+  writeValue(stream, normals ? normalsFlag : uint32_t(0));
+  writeValue(stream, uint64_t(width));
+  writeValue(stream, uint64_t(height));
+  writeValue(stream, uint64_t(depth));
+  writeValue(stream, scale.x);
+  writeValue(stream, scale.y);
+  writeValue(stream, scale.z);
+  for (const BrickEntry& e : entries) {
+    writeValue(stream, e.offset);
+    writeValue(stream, e.size);
+    writeValue(stream, e.normalOffset);
+    writeValue(stream, e.normalSize);
+    writeValue(stream, e.minValue);
+    writeValue(stream, e.maxValue);
+  }
+  for (size_t b = 0;b<brickCount;++b) {
+    stream.write((const char*)payloads[b].data(), std::streamsize(payloads[b].size()));
+    stream.write((const char*)normalPayloads[b].data(), std::streamsize(normalPayloads[b].size()));
+  }
+  if (!stream) throw VolumeContainerException{std::string("Unable to write file ")+filename};
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <MappedFile.h>
+
+#include "Volume.h"
+
+class VolumeContainerException : public std::exception {
+public:
+  VolumeContainerException(const std::string& whatStr) : whatStr(whatStr) {}
+  virtual const char* what() const throw() {
+    return whatStr.c_str();
+  }
+private:
+  std::string whatStr;
+};
+
+// single file binary volume format: a fixed header, a table with the
+// location and value range of every brick, and the bricks themselves,
+// each delta coded along x and compressed with the LZ coder on its own
+// (optionally followed by octahedral normals), so bricks can be decoded
+// independently, on demand and in parallel
+//
+// layout (little endian):
+//   char[4] magic "QVB1", uint32 version
+//   uint32 bytesPerVoxel, uint32 brickSize, uint32 flags
+//   uint64 width, height, depth, float scale[3]
+//   BrickEntry[brickCount], brick payloads
+class VolumeContainer {
+public:
+  struct BrickEntry {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t normalOffset;
+    uint64_t normalSize;
+    uint32_t minValue;
+    uint32_t maxValue;
+  };
+
+  VolumeContainer(const std::string& filename);
+
+  static bool isContainer(const std::string& filename);
+
+  size_t width;
+  size_t height;
+  size_t depth;
+  Vec3 scale;
+  size_t bytesPerVoxel;
+  size_t brickSize;
+  bool hasNormals;
+
+  size_t getVoxelCount() const {return width*height*depth;}
+  size_t getBrickCount() const {return bricks.size();}
+  const BrickEntry& getBrick(size_t index) const {return bricks[index];}
+
+  size_t getBrickIndex(size_t bx, size_t by, size_t bz) const;
+  void getBrickOrigin(size_t index, size_t& x, size_t& y, size_t& z) const;
+  void getBrickExtent(size_t index, size_t& x, size_t& y, size_t& z) const;
+
+  // decodes one brick, its extent voxels with x running fastest, into
+  // target; the file is memory mapped so only this brick is touched
+  void readBrick(size_t index, void* target) const;
+  void readBrickNormals(size_t index, uint16_t* target) const;
+
+  // decodes all bricks in parallel into a flat volume
+  template <typename T>
+  VolumeT<T> readVolume() const {
+    if (sizeof(T) != bytesPerVoxel)
+      throw VolumeContainerException("voxel size mismatch");
+    VolumeT<T> volume;
+    volume.width = width;
+    volume.height = height;
+    volume.depth = depth;
+    volume.scale = scale;
+    volume.normalizeScale();
+    volume.data.resize(getVoxelCount());
+    if (hasNormals) volume.compactNormals.resize(getVoxelCount());
+    readVolume((uint8_t*)volume.data.data(),
+               hasNormals ? volume.compactNormals.data() : nullptr);
+    return volume;
+  }
+
+  // stores the normals of the volume if it has a field, otherwise
+  // they are derived from the voxels when withNormals is set
+  template <typename T>
+  static void write(const std::string& filename, const VolumeT<T>& volume,
+                    size_t brickSize=32, bool withNormals=false) {
+    std::vector<uint16_t> normals;
+    if (withNormals || volume.hasNormals()) {
+      normals.resize(volume.getVoxelCount());
+      const size_t sliceSize = volume.width*volume.height;
+#pragma omp parallel for schedule(static)
+      for (int64_t w = 0;w<int64_t(volume.depth);++w) {
+        for (size_t v = 0;v<volume.height;++v) {
+          for (size_t u = 0;u<volume.width;++u) {
+            const size_t index = u + v*volume.width + size_t(w)*sliceSize;
+            normals[index] = volume.compactNormals.empty()
+              ? Octahedral::encode16(volume.getNormal(u, v, size_t(w)))
+              : volume.compactNormals[index];
+          }
+        }
+      }
+    }
+    write(filename, (const uint8_t*)volume.getData(), sizeof(T),
+          volume.width, volume.height, volume.depth, volume.scale,
+          brickSize, normals.empty() ? nullptr : normals.data());
+  }
+
+private:
+  std::shared_ptr<MappedFile> file;
+  std::vector<BrickEntry> bricks;
+  size_t bricksX;
+  size_t bricksY;
+  size_t bricksZ;
+
+  void readVolume(uint8_t* voxels, uint16_t* normals) const;
+  // the same as the public versions with a caller owned scratch buffer
+  void readBrick(size_t index, void* target, std::vector<uint8_t>& shuffled) const;
+  void readBrickNormals(size_t index, uint16_t* target,
+                        std::vector<uint8_t>& shuffled) const;
+  void decode(uint64_t offset, uint64_t size, uint8_t* target,
+              size_t targetSize) const;
+
+  static void write(const std::string& filename, const uint8_t* voxels,
+                    size_t bytesPerVoxel, size_t width, size_t height,
+                    size_t depth, const Vec3& scale, size_t brickSize,
+                    const uint16_t* normals);
+};
@@ -0,0 +1,174 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "QVis.h"
+#include "MC.h"
+
+struct MeshCounts {
+  size_t triangles{0};
+  size_t vertices{0};
+
+  MeshCounts() {}
+  MeshCounts(const Isosurface& surface) :
+    triangles{surface.indices.empty() ? surface.vertices.size()/3 : surface.indices.size()/3},
+    vertices{surface.vertices.size()}
+  {}
+
+  bool operator==(const MeshCounts& other) const {
+    return triangles == other.triangles && vertices == other.vertices;
+  }
+  bool operator!=(const MeshCounts& other) const {return !(*this == other);}
+};
+
+static std::ostream& operator<<(std::ostream& stream, const MeshCounts& counts) {
+  return stream << counts.triangles << " triangles, " << counts.vertices << " vertices";
+}
+
+// best of several runs, the first one also pays for page faults in the
+// freshly allocated output
+template <typename F>
+static double time(F extract, size_t runs, MeshCounts& counts) {
+  double best = 0.0;
+  for (size_t run = 0;run<runs;++run) {
+    const auto start = std::chrono::steady_clock::now();
+    const Isosurface surface = extract();
+    const auto end = std::chrono::steady_clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(end-start).count();
+    best = (run == 0) ? ms : std::min(best, ms);
+    counts = MeshCounts{surface};
+  }
+  return best;
+}
+
+// all algorithms extract the same cells, so a timing of one that
+// produces a different mesh than marching cubes is meaningless
+static bool check(const std::string& what, const MeshCounts& reference,
+                  const MeshCounts& counts) {
+  if (counts == reference) return true;
+  std::cerr << "MISMATCH: " << what << " gives " << counts
+            << ", marching cubes " << reference << std::endl;
+  return false;
+}
+
+// extraction time of classic marching cubes, flying edges and marching
+// cubes over the active bricks of a min/max octree and of a bricked copy
+// of the volume for triangle soups and indexed meshes, then of all isovalues separately and batched;
+// false if the meshes of the algorithms differ
+static bool report(const std::string& filename, const std::vector<uint8_t>& isovalues,
+                   size_t runs) {
+  const QVis qvis{filename, true};
+  const Volume& volume = qvis.volume;
+  std::cout << filename << " (" << volume.width << "x" << volume.height << "x"
+            << volume.depth << ")" << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  const MinMaxOctree octree{volume};
+  auto end = std::chrono::steady_clock::now();
+  std::cout << "octree of " << octree.getBrickCount() << " bricks built in " << std::fixed
+            << std::setprecision(1) << std::chrono::duration<double, std::milli>(end-start).count()
+            << " ms" << std::endl;
+  start = std::chrono::steady_clock::now();
+  const BrickedVolume bricked{volume};
+  end = std::chrono::steady_clock::now();
+  std::cout << "bricked copy of " << bricked.getBrickCount() << " bricks built in "
+            << std::chrono::duration<double, std::milli>(end-start).count() << " ms" << std::endl;
+
+  std::cout << std::setw(5) << "iso" << std::setw(9) << "mesh"
+            << std::setw(12) << "triangles" << std::setw(12) << "vertices"
+            << std::setw(12) << "MC [ms]" << std::setw(12) << "FE [ms]"
+            << std::setw(14) << "octree [ms]" << std::setw(15) << "bricked [ms]" << std::endl;
+  bool consistent = true;
+  // per indexed flag the counts of every isovalue, for the batched pass
+  std::vector<MeshCounts> counts[2];
+  for (const uint8_t isovalue : isovalues) {
+    for (const bool indexed : {false, true}) {
+      MeshCounts mcCounts, feCounts, bricksCounts, brickedCounts;
+      const double mc = time([&]() {
+        return Isosurface{volume, isovalue, indexed, IsosurfaceAlgorithm::MarchingCubes};
+      }, runs, mcCounts);
+      const double fe = time([&]() {
+        return Isosurface{volume, isovalue, indexed, IsosurfaceAlgorithm::FlyingEdges};
+      }, runs, feCounts);
+      const double bricks = time([&]() {
+        return Isosurface{volume, octree, isovalue, indexed};
+      }, runs, bricksCounts);
+      const double brickedMs = time([&]() {
+        return Isosurface{volume, bricked, isovalue, indexed};
+      }, runs, brickedCounts);
+      counts[indexed].push_back(mcCounts);
+      std::cout << std::setw(5) << int(isovalue) << std::setw(9)
+                << (indexed ? "indexed" : "soup") << std::setw(12) << mcCounts.triangles
+                << std::setw(12) << mcCounts.vertices << std::fixed << std::setprecision(1)
+                << std::setw(12) << mc << std::setw(12) << fe
+                << std::setw(14) << bricks << std::setw(15) << brickedMs << std::endl;
+
+      const std::string mesh = std::string(indexed ? " indexed" : " soup") +
+                               " at isovalue " + std::to_string(int(isovalue));
+      consistent &= check("flying edges" + mesh, mcCounts, feCounts);
+      consistent &= check("octree" + mesh, mcCounts, bricksCounts);
+      consistent &= check("bricked" + mesh, mcCounts, brickedCounts);
+    }
+  }
+
+  // all isovalues one after the other against a single batched pass
+  for (const bool indexed : {false, true}) {
+    double separate = 0.0, batched = 0.0;
+    std::vector<Isosurface> surfaces;
+    for (size_t run = 0;run<runs;++run) {
+      auto start = std::chrono::steady_clock::now();
+      for (const uint8_t isovalue : isovalues) Isosurface{volume, isovalue, indexed};
+      auto end = std::chrono::steady_clock::now();
+      const double separateMs = std::chrono::duration<double, std::milli>(end-start).count();
+      start = std::chrono::steady_clock::now();
+      surfaces = Isosurface::extractAll(volume, isovalues, indexed);
+      end = std::chrono::steady_clock::now();
+      const double batchedMs = std::chrono::duration<double, std::milli>(end-start).count();
+      separate = (run == 0) ? separateMs : std::min(separate, separateMs);
+      batched = (run == 0) ? batchedMs : std::min(batched, batchedMs);
+    }
+    std::cout << "all " << isovalues.size() << " isovalues " << (indexed ? "indexed" : "soup")
+              << ": separate " << std::fixed << std::setprecision(1) << separate
+              << " ms, batched " << batched << " ms" << std::endl;
+    for (size_t i = 0;i<isovalues.size();++i)
+      consistent &= check(std::string("batched ") + (indexed ? "indexed" : "soup") +
+                          " at isovalue " + std::to_string(int(isovalues[i])),
+                          counts[indexed][i], MeshCounts{surfaces[i]});
+  }
+  return consistent;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " dataset... [--iso value]... [--runs count]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::string> filenames;
+  std::vector<uint8_t> isovalues;
+  size_t runs = 3;
+  for (int i = 1;i<argc;++i) {
+    const std::string argument = argv[i];
+    if (argument == "--iso" && i+1 < argc)
+      isovalues.push_back(uint8_t(std::stoul(argv[++i])));
+    else if (argument == "--runs" && i+1 < argc)
+      runs = std::max<size_t>(std::stoul(argv[++i]), 1);
+    else
+      filenames.push_back(argument);
+  }
+  if (isovalues.empty()) isovalues = {40, 128};
+
+  bool consistent = true;
+  try {
+    for (const std::string& filename : filenames)
+      consistent &= report(filename, isovalues, runs);
+  } catch (const QVisFileException& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,76 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <limits>
+#include <stdexcept>
+#include <filesystem>
+
+#include "QVis.h"
+
+static int usage(const char* program) {
+  std::cerr << "usage: " << program
+            << " dataset.dat output.qvb [--brick size] [--normals]" << std::endl;
+  return EXIT_FAILURE;
+}
+
+// the whole of text as a number in [1, max], throws
+// std::invalid_argument or std::out_of_range otherwise
+static size_t parseSize(const std::string& text, size_t max) {
+  if (text.empty() || text[0] == '-' || text[0] == '+')
+    throw std::invalid_argument{text};
+  size_t length;
+  const unsigned long long value = std::stoull(text, &length);
+  if (length != text.size()) throw std::invalid_argument{text};
+  if (value == 0 || value > max) throw std::out_of_range{text};
+  return size_t(value);
+}
+
+// converts a .dat/.raw pair into a compressed, bricked container that
+// QVis, MCExport and the raycaster load in place of the .dat file;
+// 16 bit data sets stay 16 bit, with --normals the gradients are
+// precomputed and stored along with the voxels
+int main(int argc, char** argv) {
+  if (argc < 3) return usage(argv[0]);
+
+  const std::string dataset = argv[1];
+  const std::string output = argv[2];
+  size_t brickSize = 32;
+  bool withNormals = false;
+  try {
+    for (int i = 3;i<argc;++i) {
+      const std::string argument = argv[i];
+      if (argument == "--brick" && i+1 < argc)
+        brickSize = parseSize(argv[++i], std::numeric_limits<uint32_t>::max());
+      else if (argument == "--normals")
+        withNormals = true;
+      else
+        return usage(argv[0]);
+    }
+  } catch (const std::logic_error&) {
+    // std::invalid_argument or std::out_of_range from the conversion
+    return usage(argv[0]);
+  }
+
+  try {
+    const auto start = std::chrono::steady_clock::now();
+    const QVis qvis{dataset, true, true};
+    qvis.save(output, brickSize, withNormals);
+    const auto end = std::chrono::steady_clock::now();
+
+    const size_t rawSize = qvis.is16Bit() ? qvis.volume16.getVoxelCount()*2
+                                          : qvis.volume.getVoxelCount();
+    const size_t containerSize = size_t(std::filesystem::file_size(output));
+    std::cout << dataset << " (" << rawSize << " bytes of voxels) written to " << output
+              << " (" << containerSize << " bytes) in " << std::fixed << std::setprecision(1)
+              << std::chrono::duration<double, std::milli>(end-start).count() << " ms"
+              << std::endl;
+  } catch (const QVisFileException& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (const std::filesystem::filesystem_error& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
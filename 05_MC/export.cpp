@@ -0,0 +1,94 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <limits>
+#include <stdexcept>
+
+#include "QVis.h"
+#include "MC.h"
+#include "MeshWriter.h"
+
+static int usage(const char* program) {
+  std::cerr << "usage: " << program
+            << " dataset isovalue(0-255) output.ply|output.stl [cache MB]" << std::endl;
+  return EXIT_FAILURE;
+}
+
+// the whole of text as a number no larger than max, throws
+// std::invalid_argument or std::out_of_range otherwise
+static unsigned long parseUnsigned(const std::string& text, unsigned long max) {
+  if (text.empty() || text[0] == '-' || text[0] == '+')
+    throw std::invalid_argument{text};
+  size_t length;
+  const unsigned long value = std::stoul(text, &length);
+  if (length != text.size()) throw std::invalid_argument{text};
+  if (value > max) throw std::out_of_range{text};
+  return value;
+}
+
+// extracts one isosurface and writes it to a binary PLY or STL file
+// slab by slab, so only one slab of the mesh is in memory at any time;
+// containers are streamed brick layer by brick layer, other data sets
+// are memory mapped; 16 bit data is squashed into 8 bit one slab at a
+// time, so the isovalue refers to the same values as in the viewer;
+// no window or GPU required
+int main(int argc, char** argv) {
+  if (argc < 4) return usage(argv[0]);
+
+  const std::string dataset = argv[1];
+  const std::string output = argv[3];
+  uint8_t isovalue;
+  size_t cacheBudget = size_t(256)*1024*1024;
+  try {
+    isovalue = uint8_t(parseUnsigned(argv[2], 255));
+    if (argc > 4)
+      cacheBudget = size_t(parseUnsigned(argv[4], std::numeric_limits<size_t>::max()/(1024*1024)))
+                    *1024*1024;
+  } catch (const std::logic_error&) {
+    // std::invalid_argument or std::out_of_range from the conversions
+    return usage(argv[0]);
+  }
+
+  try {
+    const MeshFileFormat format = MeshWriter::formatOf(output);
+    // STL has no shared vertices, so indexing would not save anything
+    const bool indexed = format == MeshFileFormat::PLY;
+    MeshWriter writer{output, format};
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto write = [&writer](const Isosurface& slab) {writer.write(slab);};
+    if (VolumeContainer::isContainer(dataset)) {
+      if (VolumeContainer{dataset}.bytesPerVoxel == 2) {
+        StreamingVolume16 volume{dataset, cacheBudget};
+        Isosurface::stream(volume, isovalue, indexed, write);
+      } else {
+        StreamingVolume volume{dataset, cacheBudget};
+        Isosurface::stream(volume, isovalue, indexed, write);
+      }
+    } else {
+      const QVis qvis{dataset, true, true};
+      if (qvis.is16Bit())
+        Isosurface::stream(qvis.volume16, isovalue, indexed, write);
+      else
+        Isosurface::stream(qvis.volume, isovalue, indexed, write);
+    }
+    writer.close();
+    const auto end = std::chrono::steady_clock::now();
+
+    std::cout << writer.getTriangleCount() << " triangles, " << writer.getVertexCount()
+              << " vertices written to " << output << " in " << std::fixed
+              << std::setprecision(1) << std::chrono::duration<double, std::milli>(end-start).count()
+              << " ms" << std::endl;
+  } catch (const QVisFileException& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (const VolumeContainerException& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  } catch (const MeshWriterException& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
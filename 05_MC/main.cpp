@@ -4,15 +4,37 @@
 
 #include "QVis.h"
 #include "MC.h"
+#include "IsosurfaceCache.h"
+#include "LODIsosurface.h"
 
 class MyGLApp : public GLApp {
 public:
-  std::vector<float> data;
-  QVis q{"bonsai.dat"};
+  // 12 byte vertices instead of 40 in the interleaved layout
+  VertexFormat format{VertexFormat::Compact};
+  // vertices and indices of the current isosurface, shared with the
+  // cache and uploaded without a copy
+  IsosurfaceCache::Surface surface;
+  QVis q{"bonsai.dat", true};
+  // built once, so changing the isovalue only visits the active bricks
+  MinMaxOctree octree{q.volume};
+  // surfaces viewed recently and those next to the current isovalue
+  IsosurfaceCache cache{q.volume, octree, format};
   uint8_t isovalue{40};
+  // coarser blocks away from the camera, re-extracted as it moves
+  LODIsosurface lod{q.volume, isovalue, format};
   float eye{2.0f};
   bool wireframe{false};
+  IsosurfaceAlgorithm algorithm{IsosurfaceAlgorithm::FlyingEdges};
+  bool useOctree{true};
+  bool useCache{true};
+  bool useLOD{false};
   bool surfaceChanged{true};
+  // cuts away the part of the surface in front of a plane that faced the
+  // camera when it was switched on, so the inside can be seen
+  bool useClipPlane{false};
+  Vec3 clipNormal{0,0,1};
+  float clipOffset{0.0f};
+  IsosurfaceCache::Surface clipped;
   ArcBall arcball{{512, 512}};
   Mat4 rotation;
   bool leftMouseDown{false};
@@ -25,22 +47,29 @@ public:
   
   void extractIsosurface() {
     surfaceChanged = true;
-    Isosurface s{q.volume,isovalue};
-    data.clear();
-    for (const Vertex& v : s.vertices) {
-      data.push_back(v.position[0]);
-      data.push_back(v.position[1]);
-      data.push_back(v.position[2]);
-       
-      data.push_back(v.position[0]+0.5f);
-      data.push_back(v.position[1]+0.5f);
-      data.push_back(v.position[2]+0.5f);
-      data.push_back(1.0f);
+    if (useLOD) {
+      lod.setIsovalue(isovalue);
+      lod.update(lodCamera());
+      // even if the LOD surface is unchanged, a different one may be shown
+      // now; lod outlives the app's use of it, so it is shared, not copied
+      surface = IsosurfaceCache::Surface{&lod.getSurface(), [](const Isosurface*) {}};
+    } else if (useCache)
+      surface = cache.get(isovalue, algorithm, useOctree);
+    else if (useOctree)
+      surface = std::make_shared<const Isosurface>(q.volume,octree,isovalue,true,format);
+    else
+      surface = std::make_shared<const Isosurface>(q.volume,isovalue,true,algorithm,format);
+  }
 
-      data.push_back(v.normal[0]);
-      data.push_back(v.normal[1]);
-      data.push_back(v.normal[2]);
-    }
+  // the camera in the coordinates of the surface
+  Vec3 lodCamera() const {
+    return Mat4::inverse(rotation) * Vec3{0,0,eye};
+  }
+
+  void updateLOD() {
+    if (!useLOD) return;
+    // surface already points to the LOD surface, which changes in place
+    if (lod.update(lodCamera())) surfaceChanged = true;
   }
   
   virtual void draw() override {
@@ -53,7 +82,17 @@ public:
     setDrawTransform(Mat4::lookAt({0,0,eye},{0,0,0},{0,1,0}) * rotation);
 
     if (surfaceChanged) {
-      drawTriangles(data, TrisDrawType::LIST, wireframe, true);
+      if (useClipPlane)
+        clipped = std::make_shared<const Isosurface>(surface->clip(clipNormal, -clipOffset));
+      const Isosurface& shown = useClipPlane ? *clipped : *surface;
+      if (format == VertexFormat::Compact)
+        drawCompactTriangles(shown.compact.data(), shown.getVertexCount(),
+                             shown.indices.data(), shown.indices.size(),
+                             shown.boundsMin, shown.boundsSize, wireframe);
+      else
+        drawIndexedTriangles(shown.interleaved.data(), shown.getVertexCount(),
+                             shown.indices.data(), shown.indices.size(),
+                             wireframe, true);
       surfaceChanged = false;
     } else {
       redrawTriangles(wireframe);
@@ -72,14 +111,45 @@ public:
           surfaceChanged = true;
           std::cout << "wireframe is now " << wireframe << std::endl;
           break;
+        case GLENV_KEY_F:
+          algorithm = (algorithm == IsosurfaceAlgorithm::FlyingEdges)
+                        ? IsosurfaceAlgorithm::MarchingCubes
+                        : IsosurfaceAlgorithm::FlyingEdges;
+          extractIsosurface();
+          std::cout << "flying edges is now "
+                    << (algorithm == IsosurfaceAlgorithm::FlyingEdges) << std::endl;
+          break;
+        case GLENV_KEY_O:
+          useOctree = !useOctree;
+          extractIsosurface();
+          std::cout << "octree is now " << useOctree << std::endl;
+          break;
+        case GLENV_KEY_C:
+          useCache = !useCache;
+          extractIsosurface();
+          std::cout << "isosurface cache is now " << useCache << std::endl;
+          break;
+        case GLENV_KEY_L:
+          useLOD = !useLOD;
+          extractIsosurface();
+          std::cout << "level of detail is now " << useLOD << std::endl;
+          break;
+        case GLENV_KEY_P:
+          useClipPlane = !useClipPlane;
+          clipNormal = Vec3::normalize(lodCamera());
+          surfaceChanged = true;
+          std::cout << "clip plane is now " << useClipPlane << std::endl;
+          break;
       }
     }
     switch (key) {
       case GLENV_KEY_UP:
         eye *= 0.9f;
+        updateLOD();
         break;
       case GLENV_KEY_DOWN:
         eye /= 0.9f;
+        updateLOD();
         break;
       case GLENV_KEY_LEFT:
         isovalue++;
@@ -89,6 +159,14 @@ public:
         isovalue--;
         extractIsosurface();
         break;
+      case GLENV_KEY_COMMA:
+        clipOffset -= 0.02f;
+        if (useClipPlane) surfaceChanged = true;
+        break;
+      case GLENV_KEY_PERIOD:
+        clipOffset += 0.02f;
+        if (useClipPlane) surfaceChanged = true;
+        break;
     }
   }
 
@@ -97,6 +175,7 @@ public:
       const Quaternion q = arcball.drag({uint32_t(xPosition),uint32_t(yPosition)});
       arcball.click({uint32_t(xPosition),uint32_t(yPosition)});
       rotation = q.computeRotation() * rotation;
+      updateLOD();
     }
   }
   virtual void mouseButton(int button, int state, int mods, double xPosition, double yPosition) override {
@@ -139,6 +139,42 @@ GLApp::GLApp(uint32_t w, uint32_t h, uint32_t s,
     FragColor = vec4(color.rgb*abs(dot(nlightDir,nnormal)),color.a);
   }
   )")},
+  simpleCompactLightProg{GLProgram::createFromString(R"(#version 300 es
+  uniform mat4 MVP;
+  uniform mat4 MV;
+  uniform mat4 MVit;
+  uniform vec3 boundsMin;
+  uniform vec3 boundsSize;
+  in vec4 vPos;
+  in vec2 vNormal;
+  out vec4 color;
+  out vec3 normal;
+  out vec3 pos;
+  vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0-abs(e.x)-abs(e.y));
+    if (n.z < 0.0)
+      n.xy = (1.0-abs(n.yx))*vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+  }
+  void main() {
+    vec3 p = boundsMin + vPos.xyz*boundsSize;
+    gl_Position = MVP * vec4(p, 1.0);
+    pos = (MV * vec4(p, 1.0)).xyz;
+    color = vec4(vPos.xyz, 1.0);
+    normal = (MVit * vec4(octDecode(vNormal), 0.0)).xyz;
+  }
+  )",R"(#version 300 es
+    precision mediump float;
+    in vec4 color;
+    in vec3 pos;
+  in vec3 normal;
+  out vec4 FragColor;
+  void main() {
+    vec3 nnormal = normalize(normal);
+    vec3 nlightDir = normalize(vec3(0.0,0.0,0.0)-pos);
+    FragColor = vec4(color.rgb*abs(dot(nlightDir,nnormal)),color.a);
+  }
+  )")},
 #else
   simpleProg{GLProgram::createFromString(
      "#version 410\n"
@@ -252,14 +288,52 @@ GLApp::GLApp(uint32_t w, uint32_t h, uint32_t s,
      "    vec3 nlightDir = normalize(vec3(0.0,0.0,0.0)-pos);"
      "    FragColor = color*abs(dot(nlightDir,nnormal));\n"
      "}\n")},
+  simpleCompactLightProg{GLProgram::createFromString(
+     "#version 410\n"
+     "uniform mat4 MVP;\n"
+     "uniform mat4 MV;\n"
+     "uniform mat4 MVit;\n"
+     "uniform vec3 boundsMin;\n"
+     "uniform vec3 boundsSize;\n"
+     "layout (location = 0) in vec4 vPos;\n"
+     "layout (location = 1) in vec2 vNormal;\n"
+     "out vec4 color;\n"
+     "out vec3 normal;\n"
+     "out vec3 pos;\n"
+     "vec3 octDecode(vec2 e) {\n"
+     "    vec3 n = vec3(e, 1.0-abs(e.x)-abs(e.y));\n"
+     "    if (n.z < 0.0)\n"
+     "        n.xy = (1.0-abs(n.yx))*vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+     "    return normalize(n);\n"
+     "}\n"
+     "void main() {\n"
+     "    vec3 p = boundsMin + vPos.xyz*boundsSize;\n"
+     "    gl_Position = MVP * vec4(p, 1.0);\n"
+     "    pos = (MV * vec4(p, 1.0)).xyz;\n"
+     "    color = vec4(vPos.xyz, 1.0);\n"
+     "    normal = (MVit * vec4(octDecode(vNormal), 0.0)).xyz;\n"
+     "}\n",
+     "#version 410\n"
+     "in vec4 color;\n"
+     "in vec3 pos;\n"
+     "in vec3 normal;\n"
+     "out vec4 FragColor;\n"
+     "void main() {\n"
+     "    vec3 nnormal = normalize(normal);"
+     "    vec3 nlightDir = normalize(vec3(0.0,0.0,0.0)-pos);"
+     "    FragColor = color*abs(dot(nlightDir,nnormal));\n"
+     "}\n")},
 #endif
   simpleArray{},
   simpleVb{GL_ARRAY_BUFFER},
+  simpleIb{GL_ELEMENT_ARRAY_BUFFER},
   raster{GL_LINEAR, GL_LINEAR,GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE},
   pointSprite{GL_LINEAR, GL_LINEAR,GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE},
   pointSpriteHighlight{GL_LINEAR, GL_LINEAR,GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE},
   resumeTime{0},
-  animationActive{true}
+  animationActive{true},
+  lastIndexed{false},
+  lastCompact{false}
 {
 #ifdef __EMSCRIPTEN__
   glEnv.setMouseCallbacks(cursorPositionCallback, mouseButtonCallback,
@@ -554,7 +628,14 @@ void GLApp::drawPoints(const std::vector<float>& data, float pointSize, bool use
 void GLApp::redrawTriangles(bool wireframe) {
   shaderUpdate();
 
-  if (lastLighting) {
+  if (lastCompact) {
+    simpleCompactLightProg.enable();
+    simpleArray.bind();
+    simpleArray.connectTypedVertexAttrib(simpleVb, simpleCompactLightProg, "vPos", 4,
+                                         GL_UNSIGNED_SHORT, true, 0);
+    simpleArray.connectTypedVertexAttrib(simpleVb, simpleCompactLightProg, "vNormal", 2,
+                                         GL_SHORT, true, 8);
+  } else if (lastLighting) {
     simpleLightProg.enable();
     simpleArray.bind();
     simpleArray.connectVertexAttrib(simpleVb, simpleLightProg, "vPos", 3);
@@ -568,6 +649,12 @@ void GLApp::redrawTriangles(bool wireframe) {
   }
 
 
+  if (lastIndexed) {
+    simpleIb.bind();
+    GL(glDrawElements(wireframe ? GL_LINES : GL_TRIANGLES, lastTrisCount, GL_UNSIGNED_INT, (void*)0));
+    return;
+  }
+
   switch (lastTrisType) {
     case TrisDrawType::LIST :
       if (wireframe) {
@@ -720,10 +807,68 @@ void GLApp::drawTriangles(const std::vector<float>& data, TrisDrawType t, bool w
   }
   lastLighting = lighting;
   lastTrisType = t;
+  lastIndexed = false;
+  lastCompact = false;
+
+  redrawTriangles(wireframe);
+}
+
+void GLApp::drawIndexedTriangles(const float* data, size_t vertexCount,
+                                 const uint32_t* indices, size_t indexCount,
+                                 bool wireframe, bool lighting) {
+  shaderUpdate();
+
+  size_t compCount = lighting ? 10 : 7;
+  simpleVb.setData(data,vertexCount*compCount,compCount,GL_DYNAMIC_DRAW);
+
+  setIndices(indices, indexCount, wireframe);
+  lastLighting = lighting;
+  lastTrisType = TrisDrawType::LIST;
+  lastIndexed = true;
+  lastCompact = false;
+
+  redrawTriangles(wireframe);
+}
+
+void GLApp::drawCompactTriangles(const uint16_t* data, size_t vertexCount,
+                                 const uint32_t* indices, size_t indexCount,
+                                 const Vec3& boundsMin, const Vec3& boundsSize,
+                                 bool wireframe) {
+  simpleVb.setRawData(data,vertexCount,6*sizeof(uint16_t),GL_DYNAMIC_DRAW);
+  simpleCompactLightProg.enable();
+  simpleCompactLightProg.setUniform("boundsMin", boundsMin);
+  simpleCompactLightProg.setUniform("boundsSize", boundsSize);
+
+  setIndices(indices, indexCount, wireframe);
+  lastLighting = true;
+  lastTrisType = TrisDrawType::LIST;
+  lastIndexed = true;
+  lastCompact = true;
 
   redrawTriangles(wireframe);
 }
 
+void GLApp::setIndices(const uint32_t* indices, size_t indexCount, bool wireframe) {
+  // the index buffer binding is part of the vertex array state
+  simpleArray.bind();
+  if (wireframe) {
+    std::vector<uint32_t> lineIndices(indexCount*2);
+    for (size_t i = 0;i+2<indexCount;i += 3) {
+      lineIndices[i*2+0] = indices[i];
+      lineIndices[i*2+1] = indices[i+1];
+      lineIndices[i*2+2] = indices[i+1];
+      lineIndices[i*2+3] = indices[i+2];
+      lineIndices[i*2+4] = indices[i+2];
+      lineIndices[i*2+5] = indices[i];
+    }
+    simpleIb.setData(lineIndices);
+    lastTrisCount = GLsizei(lineIndices.size());
+  } else {
+    simpleIb.setData(indices, indexCount);
+    lastTrisCount = GLsizei(indexCount);
+  }
+}
+
 void GLApp::setDrawProjection(const Mat4& mat) {
   p = mat;
 }
@@ -761,6 +906,11 @@ void GLApp::shaderUpdate() {
   simpleLightProg.setUniform("MVP", p*mv);
   simpleLightProg.setUniform("MV", mv);
   simpleLightProg.setUniform("MVit", mvi, true);
+
+  simpleCompactLightProg.enable();
+  simpleCompactLightProg.setUniform("MVP", p*mv);
+  simpleCompactLightProg.setUniform("MV", mv);
+  simpleCompactLightProg.setUniform("MVit", mvi, true);
 }
 
 void GLApp::setImageFilter(GLint magFilter, GLint minFilter) {
@@ -96,6 +96,20 @@ public:
                  const Vec3& tl=Vec3{-1.0f,1.0f,0.0f},
                  const Vec3& tr=Vec3{1.0f,1.0f,0.0f});
   void drawTriangles(const std::vector<float>& data, TrisDrawType t, bool wireframe, bool lighting);
+  // triangle list in which every vertex of 7, or with lighting 10,
+  // floats is stored once and referenced by three indices per triangle;
+  // uploaded from the caller's memory without an intermediate copy
+  void drawIndexedTriangles(const float* data, size_t vertexCount,
+                            const uint32_t* indices, size_t indexCount,
+                            bool wireframe, bool lighting);
+  // lit indexed triangles of 12 byte vertices: x, y, z as 16 bit
+  // unsigned normalized positions within [boundsMin, boundsMin+boundsSize],
+  // 16 bit of padding and the octahedral encoded normal as two 16 bit
+  // signed normalized values; the color is the position within the bounds
+  void drawCompactTriangles(const uint16_t* data, size_t vertexCount,
+                            const uint32_t* indices, size_t indexCount,
+                            const Vec3& boundsMin, const Vec3& boundsSize,
+                            bool wireframe);
   void redrawTriangles(bool wireframe);
 
   Mat4 computeImageTransform(const Vec2ui& imageSize) const;
@@ -143,8 +157,10 @@ protected:
   GLProgram simpleHLSpriteProg;
   GLProgram simpleTexProg;
   GLProgram simpleLightProg;
+  GLProgram simpleCompactLightProg;
   GLArray simpleArray;
   GLBuffer simpleVb;
+  GLBuffer simpleIb;
   GLTexture2D raster;
   GLTexture2D pointSprite;
   GLTexture2D pointSpriteHighlight;
@@ -165,9 +181,13 @@ private:
   TrisDrawType lastTrisType;
   GLsizei lastTrisCount;
   bool lastLighting;
+  bool lastIndexed;
+  bool lastCompact;
   double startTime;
 
   void mainLoop();
+  // uploads the indices of a triangle list, or of its edges for wireframe
+  void setIndices(const uint32_t* indices, size_t indexCount, bool wireframe);
 
 #ifdef __EMSCRIPTEN__
   static void mainLoopWrapper(void* arg) {
@@ -24,6 +24,18 @@ void GLArray::connectVertexAttrib(const GLBuffer& buffer,
 	buffer.connectVertexAttrib(GLuint(location), elemCount, offset, divisor);
 }
 
+void GLArray::connectTypedVertexAttrib(const GLBuffer& buffer,
+                                       const GLProgram& program,
+                                       const std::string& variable,
+                                       size_t elemCount, GLenum type,
+                                       bool normalized, size_t byteOffset,
+                                       GLuint divisor) const {
+	bind();
+	const GLint location = program.getAttributeLocation(variable.c_str());
+	buffer.connectTypedVertexAttrib(GLuint(location), elemCount, type, normalized,
+                                  byteOffset, divisor);
+}
+
 void GLArray::connectIndexBuffer(const GLBuffer& buffer) const {
 	bind();
 	buffer.bind();	
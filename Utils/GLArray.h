@@ -17,6 +17,10 @@ public:
 	void connectVertexAttrib(const GLBuffer& buffer, const GLProgram& program,
                            const std::string& variable, size_t elemCount,
                            size_t offset=0, GLuint divisor = 0) const;
+	void connectTypedVertexAttrib(const GLBuffer& buffer, const GLProgram& program,
+                                const std::string& variable, size_t elemCount,
+                                GLenum type, bool normalized, size_t byteOffset,
+                                GLuint divisor = 0) const;
 	void connectIndexBuffer(const GLBuffer& buffer) const;
 	
 private:
@@ -53,6 +53,19 @@ void GLBuffer::setData(const GLuint data[], size_t elemCount) {
   GL(glBufferData(target, GLsizeiptr(elemSize*elemCount), data, GL_STATIC_DRAW));
 }
 
+void GLBuffer::updateData(const std::vector<GLfloat>& data) {
+  GL(glBindBuffer(target, bufferID));
+  GL(glBufferSubData(target, 0, GLsizeiptr(sizeof(GLfloat)*data.size()), data.data()));
+}
+
+void GLBuffer::setRawData(const void* data, size_t elemCount, size_t stride,
+                          GLenum usage) {
+  elemSize = 1;
+  this->stride = stride;
+  type = GL_UNSIGNED_BYTE;
+  GL(glBindBuffer(target, bufferID));
+  GL(glBufferData(target, GLsizeiptr(stride*elemCount), data, usage));
+}
 
 void GLBuffer::connectVertexAttrib(GLuint location, size_t elemCount,
                                    size_t offset, GLuint divisor) const {
@@ -66,6 +79,20 @@ void GLBuffer::connectVertexAttrib(GLuint location, size_t elemCount,
   if (divisor != 0) GL(glVertexAttribDivisor(location, divisor));
 }
 
+void GLBuffer::connectTypedVertexAttrib(GLuint location, size_t elemCount, GLenum type,
+                                        bool normalized, size_t byteOffset,
+                                        GLuint divisor) const {
+  if (this->type == 0) {
+    throw GLException{"Need to call setData before connectTypedVertexAttrib"};
+  }
+
+  GL(glBindBuffer(target, bufferID));
+  GL(glEnableVertexAttribArray(location));
+  GL(glVertexAttribPointer(location, GLsizei(elemCount), type, normalized ? GL_TRUE : GL_FALSE,
+                           GLsizei(stride), (void*)byteOffset));
+  if (divisor != 0) GL(glVertexAttribDivisor(location, divisor));
+}
+
 void GLBuffer::bind() const {
 	GL(glBindBuffer(target, bufferID));
 }
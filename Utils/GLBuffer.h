@@ -15,9 +15,21 @@ public:
   void setData(const float data[], size_t elemCount,
                size_t valuesPerElement,GLenum usage=GL_STATIC_DRAW);
   void setData(const GLuint data[], size_t elemCount);
+  // overwrites the start of the storage allocated by the last setData
+  // without reallocating it, data must fit into that storage
+  void updateData(const std::vector<GLfloat>& data);
+  // elemCount elements of stride bytes each, whose attributes may have
+  // different types, see connectTypedVertexAttrib
+  void setRawData(const void* data, size_t elemCount, size_t stride,
+                  GLenum usage=GL_STATIC_DRAW);
 
 	void connectVertexAttrib(GLuint location, size_t elemCount,
                            size_t offset=0, GLuint divisor = 0) const;
+  // an attribute of the given type at byteOffset within each element,
+  // integer types are mapped to [0,1] or [-1,1] if normalized
+  void connectTypedVertexAttrib(GLuint location, size_t elemCount, GLenum type,
+                                bool normalized, size_t byteOffset,
+                                GLuint divisor = 0) const;
 	void bind() const;
   
 private:
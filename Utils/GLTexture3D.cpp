@@ -32,12 +32,7 @@ GLTexture3D::~GLTexture3D() {
 GLTexture3D::GLTexture3D(const GLTexture3D& other) :
   GLTexture3D(other.magFilter, other.minFilter, other.wrapX, other.wrapY, other.wrapZ)
 {
-  if (other.height > 0 && other.width > 0 && other.depth > 0) {
-    if (other.isFloat)
-      setData(other.fdata, other.height, other.width, other.depth, other.componentCount);
-    else
-      setData(other.data, other.height, other.width, other.depth, other.componentCount);
-  }
+  copyData(other);
 }
 
 GLTexture3D& GLTexture3D::operator=(GLTexture3D other) {
@@ -53,11 +48,33 @@ GLTexture3D& GLTexture3D::operator=(GLTexture3D other) {
     GL(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, magFilter));
     GL(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, minFilter));
     
-    if (other.height > 0 && other.width > 0 && other.depth > 0)
-      setData(other.data, other.height, other.width, other.depth, other.componentCount);
+    copyData(other);
     return *this;
 }
 
+void GLTexture3D::copyData(const GLTexture3D& other) {
+  if (other.height == 0 || other.width == 0 || other.depth == 0) return;
+  if (other.isFloat) {
+    setData(other.fdata, other.width, other.height, other.depth, other.componentCount);
+  } else if (other.type == GL_UNSIGNED_BYTE && !other.data.empty()) {
+    setData(other.data, other.width, other.height, other.depth, other.componentCount);
+  } else {
+    // uploaded from a pointer without a CPU-side copy, so the contents
+    // only exist on the GPU and are read back from there
+#ifndef __EMSCRIPTEN__
+    std::vector<GLubyte> pixels(size_t(other.getSize())*(other.type == GL_UNSIGNED_SHORT ? 2 : 1));
+    GL(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+    GL(glBindTexture(GL_TEXTURE_3D, other.id));
+    GL(glGetTexImage(GL_TEXTURE_3D, 0, other.format, other.type, pixels.data()));
+    data.clear();
+    setData((GLvoid*)pixels.data(), other.width, other.height, other.depth,
+            other.componentCount, other.type);
+#else
+    throw GLException{"Textures uploaded from a pointer cannot be copied."};
+#endif
+  }
+}
+
 const GLuint GLTexture3D::getId() const {
   return id;
 }
@@ -83,9 +100,24 @@ void GLTexture3D::setData(const std::vector<GLubyte>& data, uint32_t width, uint
   }
   
   this->data = data;
-  setData((GLvoid*)data.data(), width, height, depth, componentCount, false);
+  setData((GLvoid*)data.data(), width, height, depth, componentCount, GL_UNSIGNED_BYTE);
+}
+
+void GLTexture3D::setData(const GLubyte* data, uint32_t width, uint32_t height, uint32_t depth, uint8_t componentCount) {
+  // uploads straight from the caller's memory (e.g. a mapped file)
+  // without keeping a CPU-side copy
+  this->data.clear();
+  setData((GLvoid*)data, width, height, depth, componentCount, GL_UNSIGNED_BYTE);
 }
 
+#ifndef __EMSCRIPTEN__
+void GLTexture3D::setData(const GLushort* data, uint32_t width, uint32_t height, uint32_t depth, uint8_t componentCount) {
+  // 16bit normalized integer texture, sampled as [0,1] just like 8bit
+  this->data.clear();
+  setData((GLvoid*)data, width, height, depth, componentCount, GL_UNSIGNED_SHORT);
+}
+#endif
+
 void GLTexture3D::setData(const std::vector<GLfloat>& data) {
   setData(data,width,height,depth,componentCount);
 }
@@ -95,13 +127,14 @@ void GLTexture3D::setData(const std::vector<GLfloat>& data, uint32_t width, uint
     throw GLException{"Data size and texure dimensions do not match."};
   }
   this->fdata = data;
-  setData((GLvoid*)data.data(), width, height, depth, componentCount, true);
+  setData((GLvoid*)data.data(), width, height, depth, componentCount, GL_FLOAT);
 }
 
 void GLTexture3D::setData(GLvoid* data, uint32_t width, uint32_t height, 
                           uint32_t depth, uint8_t componentCount,
-                          bool isFloat) {
-  this->isFloat = isFloat;
+                          GLenum type) {
+  this->isFloat = type == GL_FLOAT;
+  this->type = type;
   this->width = width;
   this->height = height;
   this->depth = depth;
@@ -112,7 +145,17 @@ void GLTexture3D::setData(GLvoid* data, uint32_t width, uint32_t height,
   GL(glPixelStorei(GL_PACK_ALIGNMENT ,1));
   GL(glPixelStorei(GL_UNPACK_ALIGNMENT ,1));
   
-  type = isFloat ? GL_FLOAT : GL_UNSIGNED_BYTE;
+#ifndef __EMSCRIPTEN__
+  if (type == GL_UNSIGNED_SHORT) {
+    const GLint formats16[] = {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+    const GLenum layouts[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    internalformat = formats16[componentCount-1];
+    format = layouts[componentCount-1];
+    GL(glTexImage3D(GL_TEXTURE_3D, 0, internalformat, GLsizei(width), GLsizei(height), GLsizei(depth), 0, format, type, data));
+    return;
+  }
+#endif
+
   switch (componentCount) {
     case 1 :
       internalformat = isFloat ? GL_R32F : GL_R8;
@@ -140,6 +183,7 @@ const std::vector<GLubyte>& GLTexture3D::getDataByte() {
   GL(glPixelStorei(GL_PACK_ALIGNMENT, 1));
   GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
   GL(glBindTexture(GL_TEXTURE_3D, id));
+  data.resize(getSize() * (type == GL_UNSIGNED_SHORT ? 2 : 1));
   GL(glGetTexImage(GL_TEXTURE_3D, 0, format, type, data.data()));
   return data;
 }
@@ -18,6 +18,10 @@ public:
   void setEmpty(uint32_t width, uint32_t height, uint32_t depth, uint8_t componentCount, bool isFloat=false);
 	void setData(const std::vector<GLubyte>& data, uint32_t width, uint32_t height, uint32_t depth, uint8_t componentCount=4);
   void setData(const std::vector<GLubyte>& data);
+  void setData(const GLubyte* data, uint32_t width, uint32_t height, uint32_t depth, uint8_t componentCount=4);
+#ifndef __EMSCRIPTEN__
+  void setData(const GLushort* data, uint32_t width, uint32_t height, uint32_t depth, uint8_t componentCount=4);
+#endif
   void setData(const std::vector<GLfloat>& data, uint32_t width, uint32_t height, uint32_t depth, uint8_t componentCount=4);
   void setData(const std::vector<GLfloat>& data);
 
@@ -53,5 +57,6 @@ private:
   bool isFloat;
   
   void setData(GLvoid* data, uint32_t width, uint32_t height, uint32_t depth, 
-               uint8_t componentCount, bool isFloat);
+               uint8_t componentCount, GLenum type);
+  void copyData(const GLTexture3D& other);
 };
@@ -41,14 +41,6 @@ Grid2D::Grid2D(const Image& image) :
   }
 }
     
-size_t Grid2D::getWidth() const {
-  return width;
-}
-
-size_t Grid2D::getHeight() const {
-  return height;
-}
-
 std::string Grid2D::toString() const {
   std::stringstream s;
   for (size_t i = 0;i<data.size();++i) {
@@ -80,10 +72,6 @@ float Grid2D::getValueNormalized(float x, float y) const {
   return data[index(size_t(x*width),size_t(y*height))];
 }
 
-float Grid2D::getValue(size_t x, size_t y) const {
-  return data[index(x,y)];
-}
-
 
 float Grid2D::sample(const Vec2& pos) const  {
   return sample(pos.x, pos.y);
@@ -20,8 +20,10 @@ public:
   Grid2D(std::istream &is);
   void save(std::ostream &os) const;
 
-  size_t getWidth() const;
-  size_t getHeight() const;
+  // inline, so Image::filter does not pull Grid2D and with it GL into
+  // programs that only use Image
+  size_t getWidth() const {return width;}
+  size_t getHeight() const {return height;}
   std::string toString() const;
   std::vector<uint8_t> toByteArray() const;
   Grid2D toSignedDistance(float threshold) const;
@@ -29,7 +31,7 @@ public:
 
   void setValue(size_t x, size_t y, float value);
   float getValueNormalized(float x, float y) const;
-  float getValue(size_t x, size_t y) const;
+  float getValue(size_t x, size_t y) const {return data[x + y * width];}
   float sample(float x, float y) const ;
   float sample(const Vec2& pos) const ;
   
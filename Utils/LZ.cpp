@@ -0,0 +1,132 @@
+#include <cstring>
+#include <algorithm>
+
+#include "LZ.h"
+
+namespace LZ {
+  static const size_t minMatch = 4;
+  static const size_t maxOffset = 0xFFFF;
+  static const size_t hashBits = 16;
+
+  static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  static size_t hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - hashBits);
+  }
+
+  static void writeLength(std::vector<uint8_t>& target, size_t length) {
+    while (length >= 255) {
+      target.push_back(255);
+      length -= 255;
+    }
+    target.push_back(uint8_t(length));
+  }
+
+  static size_t readLength(const uint8_t*& ip, const uint8_t* end) {
+    size_t length = 0;
+    uint8_t b;
+    do {
+      if (ip == end) throw LZException("truncated length");
+      b = *ip++;
+      length += b;
+    } while (b == 255);
+    return length;
+  }
+
+  // a matchLength of zero marks the final, literal only sequence
+  static void writeSequence(std::vector<uint8_t>& target,
+                            const uint8_t* literals, size_t literalCount,
+                            size_t offset, size_t matchLength) {
+    const size_t matchCode = matchLength ? matchLength - minMatch : 0;
+    const uint8_t token = uint8_t((std::min<size_t>(literalCount, 15) << 4) |
+                                  std::min<size_t>(matchCode, 15));
+    target.push_back(token);
+    if (literalCount >= 15) writeLength(target, literalCount - 15);
+    target.insert(target.end(), literals, literals + literalCount);
+    if (!matchLength) return;
+
+    target.push_back(uint8_t(offset & 0xFF));
+    target.push_back(uint8_t(offset >> 8));
+    if (matchCode >= 15) writeLength(target, matchCode - 15);
+  }
+
+  std::vector<uint8_t> compress(const uint8_t* source, size_t size) {
+    std::vector<uint8_t> target;
+    target.reserve(size/2 + 16);
+
+    // positions are stored +1 so zero means empty
+    std::vector<size_t> table(size_t(1) << hashBits, 0);
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + minMatch <= size) {
+      const uint32_t sequence = read32(source + i);
+      const size_t h = hash(sequence);
+      const size_t candidate = table[h];
+      table[h] = i + 1;
+
+      if (candidate && i - (candidate - 1) <= maxOffset &&
+          read32(source + candidate - 1) == sequence) {
+        const size_t matchStart = candidate - 1;
+        size_t length = minMatch;
+        while (i + length < size && source[matchStart + length] == source[i + length])
+          ++length;
+        writeSequence(target, source + anchor, i - anchor, i - matchStart, length);
+        i += length;
+        anchor = i;
+      } else {
+        // step faster through incompressible data
+        i += 1 + ((i - anchor) >> 6);
+      }
+    }
+    writeSequence(target, source + anchor, size - anchor, 0, 0);
+    return target;
+  }
+
+  void decompress(const uint8_t* source, size_t size,
+                  uint8_t* target, size_t targetSize) {
+    const uint8_t* ip = source;
+    const uint8_t* const inEnd = source + size;
+    uint8_t* op = target;
+    uint8_t* const outEnd = target + targetSize;
+
+    while (ip < inEnd) {
+      const uint8_t token = *ip++;
+
+      size_t literalCount = token >> 4;
+      if (literalCount == 15) literalCount += readLength(ip, inEnd);
+      if (literalCount > size_t(inEnd - ip) || literalCount > size_t(outEnd - op))
+        throw LZException("literal run out of bounds");
+      // an empty run may come with an empty, null target
+      if (literalCount > 0) {
+        memcpy(op, ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+      }
+      if (ip == inEnd) break;
+
+      if (inEnd - ip < 2) throw LZException("truncated offset");
+      const size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+      ip += 2;
+      size_t length = (token & 15);
+      if (length == 15) length += readLength(ip, inEnd);
+      length += minMatch;
+      if (offset == 0 || offset > size_t(op - target) || length > size_t(outEnd - op))
+        throw LZException("match out of bounds");
+
+      const uint8_t* match = op - offset;
+      if (offset >= length) {
+        memcpy(op, match, length);
+        op += length;
+      } else {
+        // overlapping copy repeats the last offset bytes
+        for (size_t j = 0;j<length;++j) *op++ = *match++;
+      }
+    }
+
+    if (op != outEnd) throw LZException("size mismatch");
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class LZException : public std::exception {
+public:
+  LZException(const std::string& whatStr) : whatStr(whatStr) {}
+  virtual const char* what() const throw() {
+    return whatStr.c_str();
+  }
+private:
+  std::string whatStr;
+};
+
+// small LZ77 byte coder in the spirit of LZ4: a stream of sequences,
+// each a token (literal count, match length), the literals and a
+// 16bit back reference; runs compress as overlapping matches so it
+// doubles as a run length coder
+namespace LZ {
+  std::vector<uint8_t> compress(const uint8_t* source, size_t size);
+
+  // target must hold exactly the uncompressed size, throws
+  // LZException on corrupt input instead of writing out of bounds
+  void decompress(const uint8_t* source, size_t size,
+                  uint8_t* target, size_t targetSize);
+}
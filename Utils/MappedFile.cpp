@@ -0,0 +1,89 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) :
+  data(nullptr),
+  size(0),
+  fileHandle(INVALID_HANDLE_VALUE),
+  mappingHandle(nullptr)
+{
+  fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                           nullptr);
+  if (fileHandle == INVALID_HANDLE_VALUE)
+    throw MappedFileException{std::string("Unable to open file ")+filename};
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(fileHandle, &fileSize)) {
+    CloseHandle(fileHandle);
+    throw MappedFileException{std::string("Unable to query size of ")+filename};
+  }
+  size = size_t(fileSize.QuadPart);
+  if (size == 0) return;
+
+  mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY,
+                                     0, 0, nullptr);
+  if (!mappingHandle) {
+    CloseHandle(fileHandle);
+    throw MappedFileException{std::string("Unable to map file ")+filename};
+  }
+
+  data = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    throw MappedFileException{std::string("Unable to map file ")+filename};
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data) UnmapViewOfFile(data);
+  if (mappingHandle) CloseHandle(mappingHandle);
+  if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) :
+  data(nullptr),
+  size(0),
+  fileDescriptor(-1)
+{
+  fileDescriptor = open(filename.c_str(), O_RDONLY);
+  if (fileDescriptor < 0)
+    throw MappedFileException{std::string("Unable to open file ")+filename};
+
+  struct stat fileInfo;
+  if (fstat(fileDescriptor, &fileInfo) != 0) {
+    close(fileDescriptor);
+    throw MappedFileException{std::string("Unable to query size of ")+filename};
+  }
+  size = size_t(fileInfo.st_size);
+  if (size == 0) return;
+
+  void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+  if (ptr == MAP_FAILED) {
+    close(fileDescriptor);
+    throw MappedFileException{std::string("Unable to map file ")+filename};
+  }
+  // volumes are usually consumed front to back
+  madvise(ptr, size, MADV_SEQUENTIAL);
+  data = (const uint8_t*)ptr;
+}
+
+MappedFile::~MappedFile() {
+  if (data) munmap((void*)data, size);
+  if (fileDescriptor >= 0) close(fileDescriptor);
+}
+
+#endif
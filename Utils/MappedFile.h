@@ -0,0 +1,39 @@
+#pragma once
+
+#include <exception>
+#include <string>
+#include <stdint.h>
+
+class MappedFileException : public std::exception {
+public:
+  MappedFileException(const std::string& whatStr) : whatStr(whatStr) {}
+  virtual const char* what() const throw() {
+    return whatStr.c_str();
+  }
+private:
+  std::string whatStr;
+};
+
+// read-only memory mapping of a whole file, the OS pages the
+// content in on first access so nothing is copied up front
+class MappedFile {
+public:
+  MappedFile(const std::string& filename);
+  ~MappedFile();
+
+  MappedFile(const MappedFile& other) = delete;
+  MappedFile& operator=(const MappedFile& other) = delete;
+
+  const uint8_t* getData() const {return data;}
+  size_t getSize() const {return size;}
+
+private:
+  const uint8_t* data;
+  size_t size;
+#ifdef _WIN32
+  void* fileHandle;
+  void* mappingHandle;
+#else
+  int fileDescriptor;
+#endif
+};
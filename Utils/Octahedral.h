@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+
+#include "Vec2.h"
+#include "Vec3.h"
+
+// octahedral mapping of unit vectors onto the [-1,1]^2 square,
+// see Cigolle et al. "A Survey of Efficient Representations for
+// Independent Unit Vectors"; zero vectors map to (0,0,1)
+namespace Octahedral {
+  inline float signNotZero(float v) {
+    return (v >= 0.0f) ? 1.0f : -1.0f;
+  }
+
+  inline Vec2 encode(const Vec3& n) {
+    const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f) return Vec2{0.0f, 0.0f};
+    const Vec2 p{n.x/l1, n.y/l1};
+    if (n.z >= 0.0f) return p;
+    return Vec2{(1.0f - std::fabs(p.y)) * signNotZero(p.x),
+                (1.0f - std::fabs(p.x)) * signNotZero(p.y)};
+  }
+
+  inline Vec3 decode(const Vec2& e) {
+    Vec3 n{e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y)};
+    if (n.z < 0.0f) {
+      n.x = (1.0f - std::fabs(e.y)) * signNotZero(e.x);
+      n.y = (1.0f - std::fabs(e.x)) * signNotZero(e.y);
+    }
+    return Vec3::normalize(n);
+  }
+
+  inline uint32_t quantize(float v, uint32_t maxVal) {
+    const float c = std::min(1.0f, std::max(-1.0f, v));
+    return uint32_t(std::lround((c * 0.5f + 0.5f) * float(maxVal)));
+  }
+
+  inline float dequantize(uint32_t v, uint32_t maxVal) {
+    return float(v) / float(maxVal) * 2.0f - 1.0f;
+  }
+
+  // 8 bit per component
+  inline uint16_t encode16(const Vec3& n) {
+    const Vec2 e = encode(n);
+    return uint16_t(quantize(e.x, 0xFF) | (quantize(e.y, 0xFF) << 8));
+  }
+
+  inline Vec3 decode16(uint16_t v) {
+    return decode(Vec2{dequantize(v & 0xFF, 0xFF),
+                       dequantize(uint32_t(v) >> 8, 0xFF)});
+  }
+
+  // 16 bit per component
+  inline uint32_t encode32(const Vec3& n) {
+    const Vec2 e = encode(n);
+    return quantize(e.x, 0xFFFF) | (quantize(e.y, 0xFFFF) << 16);
+  }
+
+  inline Vec3 decode32(uint32_t v) {
+    return decode(Vec2{dequantize(v & 0xFFFF, 0xFFFF),
+                       dequantize(v >> 16, 0xFFFF)});
+  }
+}